@@ -0,0 +1,487 @@
+#pragma once
+
+/*! @file */
+
+#include <legion.h>
+#include <legion/legion_mapping.h>
+
+#include <atomic>
+#include <functional>
+#include <iterator>
+#include <list>
+#include <map>
+#include <mutex>
+#include <set>
+#include <tuple>
+#include <vector>
+
+namespace mapper {
+
+/*!
+ Key of a cached instance: the region it was created for, the memory it
+ lives in, the fields it holds and their dimension ordering. An instance
+ compacting several regions is created for the first of them, and the
+ others are listed in group.
+ */
+struct instance_key_t {
+  Legion::LogicalRegion region;
+  Legion::Memory memory;
+  std::set<Legion::FieldID> fields;
+  std::vector<Legion::DimensionKind> ordering;
+  std::vector<Legion::LogicalRegion> group;
+
+  bool operator<(const instance_key_t &other) const {
+    return std::tie(region, memory, fields, ordering, group) <
+           std::tie(other.region, other.memory, other.fields, other.ordering,
+                    other.group);
+  }
+
+  size_t hash() const {
+    size_t h = std::hash<unsigned long long>()(memory.id);
+    h = h * 31 + region.get_tree_id();
+    h = h * 31 + region.get_index_space().get_id();
+    h = h * 31 + region.get_field_space().get_id();
+    for (Legion::FieldID fid : fields)
+      h = h * 31 + fid;
+    for (const Legion::LogicalRegion &lr : group)
+      h = h * 31 + lr.get_index_space().get_id();
+    return h;
+  }
+}; // instance_key_t
+
+/*!
+ LRU cache of the physical instances created by the mappers of one
+ address space, bounded by a byte budget per memory. All mpi_mapper_t
+ instances of the process share it through node_cache(), so point tasks
+ of one region landing on different processors reuse each other's
+ instances.
+
+ Entries are spread over independently locked shards by the hash of their
+ key, so concurrent lookups from different processors rarely contend.
+ Every shard keeps its own LRU order, while the bytes cached in every
+ memory are counted across all shards and checked against its whole
+ budget.
+
+ The cache only keeps the bookkeeping: the mapper that creates an instance
+ protects it from garbage collection, and instances evicted by any mapper
+ are queued for their creator, which hands them back to the collector
+ (see take_released). Entries pinned by a trace are never evicted, even if
+ that keeps their memory over budget, until the trace is retired (see
+ trace_pins_t). They are dropped once the application retires the region
+ tree or partition their region belongs to (see retire_tree and
+ retire_partition), which it does when it destroys them.
+ */
+class instance_cache_t {
+public:
+  static constexpr size_t num_shards = 16;
+
+  /*!
+   The cache shared by all mappers of this address space
+   */
+  static instance_cache_t &node_cache() {
+    static instance_cache_t cache;
+    return cache;
+  }
+
+  /*!
+   Sets the budget of a memory; memories without a budget are unbounded
+   */
+  void set_budget(const Legion::Memory &memory, size_t bytes) {
+    usage(memory).budget = bytes;
+  }
+
+  size_t budget(const Legion::Memory &memory) {
+    return usage(memory).budget;
+  }
+
+  /*!
+   Bytes held by the cached instances of a memory
+   */
+  size_t used(const Legion::Memory &memory) {
+    return usage(memory).used;
+  }
+
+  /*!
+   Looks up an instance and marks it as the most recently used one. The
+   caller reports whether the lookup was a hit with count_lookup, once it
+   knows that the instance is still valid.
+   */
+  bool find(const instance_key_t &key,
+            Legion::Mapping::PhysicalInstance &instance) {
+    shard_t &shard = shard_of(key);
+    std::lock_guard<std::mutex> guard(shard.mutex);
+    auto it = shard.entries.find(key);
+    if (it == shard.entries.end())
+      return false;
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second.lru);
+    instance = it->second.instance;
+    return true;
+  } // find
+
+  void count_lookup(bool hit) {
+    if (hit)
+      hits_++;
+    else
+      misses_++;
+  }
+
+  /*!
+   Reports whether an instance is cached and its size, without touching the
+   LRU order or the counters
+   */
+  bool contains(const instance_key_t &key, size_t &size) const {
+    const shard_t &shard = shards_[key.hash() % num_shards];
+    std::lock_guard<std::mutex> guard(shard.mutex);
+    auto it = shard.entries.find(key);
+    if (it == shard.entries.end())
+      return false;
+    size = it->second.size;
+    return true;
+  } // contains
+
+  /*!
+   Adds an instance created by the mapper of processor owner as the most
+   recently used one, then, while its memory is over budget, evicts the
+   least recently used unpinned entries of that memory, those of the shard
+   of the key first. The new entry itself is never evicted. If pinned, the
+   entry is not evicted either until trace is unpinned. partition is the
+   partition the region of the key is a subregion of, if any. Returns
+   false, without caching the instance, if its region tree or partition
+   was already retired.
+   */
+  bool insert(const instance_key_t &key,
+              const Legion::Mapping::PhysicalInstance &instance, size_t size,
+              bool pinned, Legion::TraceID trace,
+              const Legion::Processor &owner,
+              const Legion::IndexPartition &partition) {
+    {
+      std::lock_guard<std::mutex> guard(retired_mutex_);
+      if (retired_trees_.count(key.region.get_tree_id()) > 0 ||
+          retired_partitions_.count(partition) > 0)
+        return false;
+    }
+
+    memory_t &memory = usage(key.memory);
+    const size_t first = key.hash() % num_shards;
+    {
+      shard_t &shard = shards_[first];
+      std::lock_guard<std::mutex> guard(shard.mutex);
+      erase_locked(shard, key);
+      shard.lru.push_front(key);
+      shard.entries[key] = {instance, size, pinned, trace, owner, partition,
+                            shard.lru.begin()};
+      memory.used += size;
+    }
+
+    std::vector<entry_t> evicted;
+    for (size_t i = 0; i < num_shards && memory.used > memory.budget; i++) {
+      shard_t &shard = shards_[(first + i) % num_shards];
+      std::lock_guard<std::mutex> guard(shard.mutex);
+      evict_locked(shard, key.memory, memory.budget, &key, evicted);
+    } // for
+    release(evicted);
+    return true;
+  } // insert
+
+  /*!
+   Evicts least recently used unpinned entries of a memory until they
+   freed at least bytes, e.g. to make room for an instance of that size
+   the runtime failed to allocate. The entries cached by the mapper of
+   processor owner go first; their instances are moved into released, so
+   that owner hands them back to the collector right away, while those of
+   other mappers are queued for them. Returns the number of freed bytes.
+   */
+  size_t trim(const Legion::Memory &memory, size_t bytes,
+              const Legion::Processor &owner,
+              std::vector<Legion::Mapping::PhysicalInstance> &released) {
+    std::vector<entry_t> evicted;
+    size_t freed = 0;
+    for (int own = 1; own >= 0; own--)
+      for (size_t i = 0; i < num_shards && freed < bytes; i++) {
+        shard_t &shard = shards_[i];
+        std::lock_guard<std::mutex> guard(shard.mutex);
+        auto it = shard.lru.end();
+        while (freed < bytes && it != shard.lru.begin()) {
+          --it;
+          const entry_t &entry = shard.entries.at(*it);
+          if (it->memory != memory || entry.pinned ||
+              (entry.owner == owner) != bool(own))
+            continue;
+          evicted.push_back(entry);
+          freed += entry.size;
+          usage(memory).used -= entry.size;
+          shard.entries.erase(*it);
+          it = shard.lru.erase(it);
+        } // while
+      }   // for
+
+    std::vector<entry_t> others;
+    for (const entry_t &entry : evicted)
+      if (entry.owner == owner)
+        released.push_back(entry.instance);
+      else
+        others.push_back(entry);
+    evictions_ += evicted.size() - others.size();
+    release(others);
+    return freed;
+  } // trim
+
+  /*!
+   Drops an entry without counting it as an eviction, e.g. because the
+   runtime already collected its instance
+   */
+  void erase(const instance_key_t &key) {
+    shard_t &shard = shard_of(key);
+    std::lock_guard<std::mutex> guard(shard.mutex);
+    erase_locked(shard, key);
+  } // erase
+
+  /*!
+   Makes the entries pinned by a trace evictable again, e.g. because the
+   trace will not be replayed anymore, and evicts entries of their
+   memories until these are back within budget
+   */
+  void unpin(Legion::TraceID trace) {
+    std::set<Legion::Memory> memories;
+    for (shard_t &shard : shards_) {
+      std::lock_guard<std::mutex> guard(shard.mutex);
+      for (auto &entry : shard.entries)
+        if (entry.second.pinned && entry.second.trace == trace) {
+          entry.second.pinned = false;
+          memories.insert(entry.first.memory);
+        } // if
+    }   // for
+
+    std::vector<entry_t> evicted;
+    for (const Legion::Memory &memory : memories) {
+      const size_t limit = budget(memory);
+      for (shard_t &shard : shards_) {
+        std::lock_guard<std::mutex> guard(shard.mutex);
+        evict_locked(shard, memory, limit, NULL, evicted);
+      } // for
+    }   // for
+    release(evicted);
+  } // unpin
+
+  /*!
+   Drops the entries of every region of a region tree, pinned or not, and
+   keeps later instances of the tree out of the cache, e.g. because the
+   application destroys the tree. Their instances are handed back to the
+   collector like evicted ones, but are not counted as evictions.
+   */
+  void retire_tree(Legion::RegionTreeID tree) {
+    {
+      std::lock_guard<std::mutex> guard(retired_mutex_);
+      retired_trees_.insert(tree);
+    }
+    retire_if([tree](const instance_key_t &key, const entry_t &) {
+      return key.region.get_tree_id() == tree;
+    });
+  } // retire_tree
+
+  /*!
+   Drops the entries of the subregions of a partition like retire_tree,
+   e.g. because the application destroys the partition
+   */
+  void retire_partition(const Legion::IndexPartition &partition) {
+    {
+      std::lock_guard<std::mutex> guard(retired_mutex_);
+      retired_partitions_.insert(partition);
+    }
+    retire_if([&partition](const instance_key_t &, const entry_t &entry) {
+      return entry.partition == partition;
+    });
+  } // retire_partition
+
+  /*!
+   Moves the evicted instances created by the mapper of processor owner
+   into released
+   */
+  void take_released(const Legion::Processor &owner,
+                     std::vector<Legion::Mapping::PhysicalInstance> &released) {
+    std::lock_guard<std::mutex> guard(released_mutex_);
+    auto it = released_.find(owner);
+    if (it == released_.end())
+      return;
+    released.insert(released.end(), it->second.begin(), it->second.end());
+    released_.erase(it);
+  } // take_released
+
+  size_t hits() const {
+    return hits_;
+  }
+  size_t misses() const {
+    return misses_;
+  }
+  size_t evictions() const {
+    return evictions_;
+  }
+
+private:
+  struct entry_t {
+    Legion::Mapping::PhysicalInstance instance;
+    size_t size;
+    bool pinned;
+    Legion::TraceID trace; // pinning the entry, if pinned
+    Legion::Processor owner;
+    Legion::IndexPartition partition; // parent of the region, if any
+    std::list<instance_key_t>::iterator lru;
+  };
+
+  struct shard_t {
+    mutable std::mutex mutex;
+    std::map<instance_key_t, entry_t> entries;
+    std::list<instance_key_t> lru; // most recently used first
+  };
+
+  // budget of a memory and bytes cached in it over all shards
+  struct memory_t {
+    std::atomic<size_t> budget{size_t(-1)};
+    std::atomic<size_t> used{0};
+  };
+
+  shard_t &shard_of(const instance_key_t &key) {
+    return shards_[key.hash() % num_shards];
+  }
+
+  // entries of the map are never removed, so references stay valid
+  memory_t &usage(const Legion::Memory &memory) {
+    std::lock_guard<std::mutex> guard(memories_mutex_);
+    return memories_[memory];
+  }
+
+  // evicts the least recently used unpinned entries of memory in shard,
+  // except keep if given, until the memory holds at most limit bytes
+  void evict_locked(shard_t &shard, const Legion::Memory &memory,
+                    size_t limit, const instance_key_t *keep,
+                    std::vector<entry_t> &evicted) {
+    memory_t &usage_of = usage(memory);
+    auto it = shard.lru.end();
+    while (usage_of.used > limit && it != shard.lru.begin()) {
+      --it;
+      if (it->memory != memory || (keep != NULL && !(*it < *keep) &&
+                                   !(*keep < *it)))
+        continue;
+      const entry_t &entry = shard.entries.at(*it);
+      if (entry.pinned)
+        continue;
+      evicted.push_back(entry);
+      usage_of.used -= entry.size;
+      shard.entries.erase(*it);
+      it = shard.lru.erase(it);
+    } // while
+  } // evict_locked
+
+  // queues evicted instances for the mappers that cached them
+  void release(const std::vector<entry_t> &evicted, bool count = true) {
+    if (evicted.empty())
+      return;
+    if (count)
+      evictions_ += evicted.size();
+    std::lock_guard<std::mutex> guard(released_mutex_);
+    for (const entry_t &entry : evicted)
+      released_[entry.owner].push_back(entry.instance);
+  } // release
+
+  // drops the entries for which dead(key, entry) holds and queues their
+  // instances for the mappers that cached them
+  template <typename PREDICATE> void retire_if(const PREDICATE &dead) {
+    std::vector<entry_t> retired;
+    for (shard_t &shard : shards_) {
+      std::lock_guard<std::mutex> guard(shard.mutex);
+      for (auto it = shard.entries.begin(); it != shard.entries.end();) {
+        if (!dead(it->first, it->second)) {
+          ++it;
+          continue;
+        } // if
+        retired.push_back(it->second);
+        usage(it->first.memory).used -= it->second.size;
+        shard.lru.erase(it->second.lru);
+        it = shard.entries.erase(it);
+      } // for
+    }   // for
+    release(retired, false);
+  } // retire_if
+
+  void erase_locked(shard_t &shard, const instance_key_t &key) {
+    auto it = shard.entries.find(key);
+    if (it == shard.entries.end())
+      return;
+    usage(key.memory).used -= it->second.size;
+    shard.lru.erase(it->second.lru);
+    shard.entries.erase(it);
+  } // erase_locked
+
+  shard_t shards_[num_shards];
+
+  std::mutex memories_mutex_;
+  std::map<Legion::Memory, memory_t> memories_;
+
+  std::mutex retired_mutex_;
+  std::set<Legion::RegionTreeID> retired_trees_;
+  std::set<Legion::IndexPartition> retired_partitions_;
+
+  std::mutex released_mutex_;
+  std::map<Legion::Processor, std::vector<Legion::Mapping::PhysicalInstance>>
+      released_;
+
+  std::atomic<size_t> hits_{0}, misses_{0}, evictions_{0};
+}; // instance_cache_t
+
+/*!
+ Tasks whose mapping is memoized by a live trace, shared by all mappers of
+ one address space: memoize_operation runs on the mapper of the processor
+ that launches an operation, while its points are mapped by the mappers
+ of other processors. Instances those mappers create for a memoized task
+ are pinned in the instance cache by its trace, since the recorded trace
+ refers to them, until the application retires the trace.
+ */
+class trace_pins_t {
+public:
+  /*!
+   The pins shared by all mappers of this address space
+   */
+  static trace_pins_t &node_pins() {
+    static trace_pins_t pins;
+    return pins;
+  }
+
+  /*!
+   Records that the mapping of task is memoized by trace
+   */
+  void memoize(Legion::TraceID trace, Legion::TaskID task) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    tasks_[task] = trace;
+  }
+
+  /*!
+   Looks up the live trace memoizing the mapping of task, if any
+   */
+  bool find(Legion::TaskID task, Legion::TraceID &trace) const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    auto it = tasks_.find(task);
+    if (it == tasks_.end())
+      return false;
+    trace = it->second;
+    return true;
+  } // find
+
+  /*!
+   Forgets the tasks memoized by a trace that will not be replayed anymore
+   and unpins the instances cached for them
+   */
+  void retire(Legion::TraceID trace) {
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      for (auto it = tasks_.begin(); it != tasks_.end();)
+        it = (it->second == trace) ? tasks_.erase(it) : std::next(it);
+    }
+    instance_cache_t::node_cache().unpin(trace);
+  } // retire
+
+private:
+  mutable std::mutex mutex_;
+  std::map<Legion::TaskID, Legion::TraceID> tasks_;
+}; // trace_pins_t
+
+} // namespace mapper
@@ -18,6 +18,19 @@
 #include <legion.h>
 #include <legion/legion_mapping.h>
 #include <mappers/default_mapper.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdlib>
+#include <map>
+#include <set>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "instance_cache.h"
+#include "mapper_stats.h"
 /*!
  Mapper ID
 
@@ -28,12 +41,142 @@ enum {
   MPI_MAPPER_ID = 1,
 };
 
+/*!
+ Sharding functor IDs, one per rank distribution of the launch tags
+
+ @ingroup legion-execution
+ */
+
+enum {
+  RANK_MATCH_SHARDING_ID = 1,
+  RANK_BLOCK_SHARDING_ID,
+  RANK_BLOCK_CYCLIC_SHARDING_ID,
+};
+
 namespace mapper {
 constexpr size_t force_rank_match = 0x00001000, compacted_storage = 0x00002000,
                  subrank_launch = 0x00003000, exclusive_lr = 0x00004000,
+                 rank_block = 0x00005000, rank_block_cyclic = 0x00006000,
                  prefer_gpu = 0x11000001, prefer_omp = 0x11000002;
+
+// flag combined with any of the tags above: instances of the task are laid
+// out AOS (fields fastest) instead of SOA
+constexpr size_t aos_layout = 0x00100000;
+
+// flag combined with any of the tags above: queued points of the launch may
+// be stolen by idle processors of the same kind in their address space
+constexpr size_t stealable = 0x00200000;
+
+// region requirement flag: a region made of several pieces, such as the
+// image of rect lists, gets an instance sized exactly to its pieces
+// instead of its bounding box; the task has to address it piece by piece
+constexpr size_t exact_pieces = 0x00400000;
+
+// region requirement tags of compacted storage: consecutive requirements
+// tagged with the same compact_group(g) are packed into one instance, as
+// are a requirement tagged exclusive_lr and the two following it
+// (exclusive, shared and ghost)
+constexpr size_t compact_group_base = 0x00008000,
+                 compact_group_mask = 0x00000fff;
+
+inline Legion::MappingTagID compact_group(size_t g) {
+  return compact_group_base | (g & compact_group_mask);
 }
 
+/*!
+ Number of consecutive requirements, starting at indx, that are packed
+ into one instance with requirement indx: 1 unless it starts a compacted
+ group
+ */
+inline size_t
+compacted_count(const std::vector<Legion::RegionRequirement> &regions,
+                size_t indx) {
+  const Legion::MappingTagID tag = regions[indx].tag;
+  if (tag == exclusive_lr) {
+    assert(indx + 3 <= regions.size());
+    return 3;
+  } // if
+  if ((tag & ~Legion::MappingTagID(compact_group_mask)) != compact_group_base)
+    return 1;
+  size_t count = 1;
+  while (indx + count < regions.size() && regions[indx + count].tag == tag)
+    count++;
+  return count;
+} // compacted_count
+
+/*!
+ Key of a registered layout: the memory kind of the instance
+ (NO_MEMKIND for no memory constraint), its fields (none for no field
+ constraint), the dimension ordering and the specialization. Exact
+ compact instances of sparse regions hold one piece per rect of the
+ region, so they are sized to its union instead of its bounding box.
+ */
+struct layout_key_t {
+  Realm::Memory::Kind kind;
+  std::vector<Legion::FieldID> fields;
+  std::vector<Legion::DimensionKind> ordering;
+  Legion::SpecializedKind specialization;
+  bool exact;
+
+  bool operator<(const layout_key_t &other) const {
+    return std::tie(kind, fields, ordering, specialization, exact) <
+           std::tie(other.kind, other.fields, other.ordering,
+                    other.specialization, other.exact);
+  }
+}; // layout_key_t
+
+/*!
+ Rank owning point p of a 1-D launch over [lo, hi] among num_ranks ranks,
+ according to the distribution selected by a launch tag:
+   force_rank_match, compacted_storage: point p goes to rank p
+   rank_block: one contiguous block of points per rank
+   rank_block_cyclic: blocks of block_size points dealt round-robin
+ */
+inline size_t rank_of(Legion::MappingTagID tag, Legion::coord_t p,
+                      Legion::coord_t lo, Legion::coord_t hi,
+                      size_t num_ranks, size_t block_size) {
+  const size_t i = p - lo;
+  switch (tag) {
+  case rank_block: {
+    const size_t n = hi - lo + 1;
+    const size_t block = (n + num_ranks - 1) / num_ranks;
+    return i / block;
+  }
+  case rank_block_cyclic:
+    return (i / block_size) % num_ranks;
+  default:
+    assert(size_t(p) < num_ranks);
+    return p;
+  } // switch
+} // rank_of
+
+/*!
+ Sharding functor of control-replicated launches: a point goes to the
+ shard of the rank slice_task sends it to for the same tag, so every shard
+ launches exactly the points its own address space executes. The mapper
+ creates shard a on address space a, which makes shards and ranks
+ interchangeable.
+ */
+class rank_sharding_t : public Legion::ShardingFunctor {
+public:
+  rank_sharding_t(Legion::MappingTagID tag, size_t block_size)
+      : tag_(tag), block_size_(block_size) {}
+
+  virtual Legion::ShardID shard(const Legion::DomainPoint &point,
+                                const Legion::Domain &full_space,
+                                const size_t total_shards) {
+    // expect a 1-D index domain
+    assert(point.get_dim() == 1);
+    return rank_of(tag_, point[0], full_space.lo()[0], full_space.hi()[0],
+                   total_shards, block_size_);
+  }
+
+private:
+  Legion::MappingTagID tag_;
+  size_t block_size_;
+}; // rank_sharding_t
+} // namespace mapper
+
 /*
  The mpi_mapper_t - is a custom mapper that handles mpi-legion
  interoperability in FLeCSI
@@ -56,7 +199,8 @@ public:
                Legion::Processor local)
       : Legion::Mapping::DefaultMapper(_runtime->get_mapper_runtime(), machine,
                                        local, "default"),
-        machine(machine) {
+        machine(machine),
+        stats_(mapper::stats_registry_t::node_registry().processor(local)) {
     using namespace Legion;
     using namespace Legion::Mapping;
     using legion_machine = Legion::Machine;
@@ -118,20 +262,86 @@ public:
       local_framebuffer = Memory::NO_MEMORY;
     }
 
+    // a representative CPU of every address space, for rank-matched
+    // slicing
     {
-      std::cout << "Mapper constructor" << std::endl
-                << "\tlocal: " << local << std::endl
-                << "\tcpus: " << local_cpus.size() << std::endl
-                << "\tgpus: " << local_gpus.size() << std::endl
-                << "\tsysmem: " << local_sysmem << std::endl;
-    } // scope
+      legion_machine::ProcessorQuery all_cpus =
+          legion_machine::ProcessorQuery(machine).only_kind(
+              legion_proc::LOC_PROC);
+      for (legion_machine::ProcessorQuery::iterator it = all_cpus.begin();
+           it != all_cpus.end(); ++it) {
+        const AddressSpace a = it->address_space();
+        if (rank_procs.size() <= a)
+          rank_procs.resize(a + 1);
+        if (!rank_procs[a].exists())
+          rank_procs[a] = *it;
+      } // for
+    }
+
+    // byte budget of the instance cache in every memory we map to: either
+    // -budget_mb KIND=N for memories of that kind, -cache_budget_mb or three
+    // quarters of the memory capacity; block size of block-cyclic rank
+    // distributions from -rank_block_size
+    {
+      size_t budget = 0;
+      std::map<std::string, size_t> kind_budgets;
+      const InputArgs &args = Runtime::get_input_args();
+      for (int i = 1; i + 1 < args.argc; i++) {
+        if (std::string(args.argv[i]) == "-cache_budget_mb")
+          budget = std::strtoull(args.argv[i + 1], NULL, 10) << 20;
+        else if (std::string(args.argv[i]) == "-budget_mb") {
+          const std::string arg(args.argv[i + 1]);
+          const size_t eq = arg.find('=');
+          const char *value = arg.c_str() + eq + 1;
+          char *end = NULL;
+          const size_t mb = (eq == std::string::npos)
+                                ? 0
+                                : std::strtoull(value, &end, 10);
+          if (eq == std::string::npos || eq == 0 || end == value ||
+              *end != '\0')
+            mapper::log_mapper().error()
+                << "ignoring malformed -budget_mb " << arg
+                << ", expected KIND=N with N in MB";
+          else
+            kind_budgets[arg.substr(0, eq)] = mb << 20;
+        }
+        else if (std::string(args.argv[i]) == "-rank_block_size")
+          rank_block_size = std::strtoull(args.argv[i + 1], NULL, 10);
+        else if (std::string(args.argv[i]) == "-mapper_stats")
+          mapper::stats_registry_t::node_registry().dump_at_exit(
+              args.argv[i + 1]);
+      } // for
+      assert(rank_block_size > 0);
+
+      std::set<Memory> memories;
+      for (auto &p : proc_mem_map)
+        for (auto &m : p.second)
+          memories.insert(m.second);
+      memories.insert(local_sysmem);
+      if (local_framebuffer.exists())
+        memories.insert(local_framebuffer);
+      for (const Memory &m : memories) {
+        auto kb = kind_budgets.find(memory_kind_name(m.kind()));
+        instance_cache().set_budget(
+            m, (kb != kind_budgets.end())
+                   ? kb->second
+                   : (budget ? budget : m.capacity() / 4 * 3));
+      } // for
+    }
+
+    mapper::log_mapper().info() << "Mapper constructor: local " << local
+                                << ", cpus " << local_cpus.size()
+                                << ", gpus " << local_gpus.size()
+                                << ", sysmem " << local_sysmem;
 
   } // end mpi_mapper_t
 
   /*!
     Destructor
    */
-  virtual ~mpi_mapper_t(){};
+  virtual ~mpi_mapper_t() {
+    mapper::stats_registry_t::node_registry().detach();
+  }
 
   Legion::LayoutConstraintID default_policy_select_layout_constraints(
       Legion::Mapping::MapperContext ctx, Realm::Memory target_memory,
@@ -142,20 +352,124 @@ public:
     // deciding to optimize for minimizing memory usage instead
     // of avoiding Write-After-Read (WAR) dependences
     force_new_instances = false;
+    const mapper::layout_key_t key{Realm::Memory::NO_MEMKIND,
+                                   {},
+                                   soa_ordering(region_dim(req)),
+                                   LEGION_NO_SPECIALIZE, false};
+    return find_layout(ctx, key).first;
+  }
+
+  /*!
+   Dimension of the index space of a region requirement
+  */
+  static int region_dim(const Legion::RegionRequirement &req) {
+    return req.parent.get_index_space().get_dim();
+  }
+
+  /*!
+   SOA ordering of the blis index spaces of dimension dim: the last
+   dimension varies fastest, i.e. the element index for 1-D meshes (DIM_Y)
+   and the last mesh axis otherwise, down to the color (DIM_X), then the
+   field
+  */
+  static std::vector<Legion::DimensionKind> soa_ordering(int dim) {
     std::vector<Legion::DimensionKind> ordering;
-    ordering.push_back(Legion::DimensionKind::DIM_Y);
-    ordering.push_back(Legion::DimensionKind::DIM_X);
+    for (int d = dim - 1; d >= 0; d--)
+      ordering.push_back(
+          static_cast<Legion::DimensionKind>(Legion::DimensionKind::DIM_X + d));
     ordering.push_back(Legion::DimensionKind::DIM_F); // SOA
-    Legion::OrderingConstraint ordering_constraint(ordering,
-                                                   true /*contiguous*/);
-    Legion::LayoutConstraintSet layout_constraint;
-    layout_constraint.add_constraint(ordering_constraint);
+    return ordering;
+  }
+
+  static std::vector<Legion::DimensionKind> aos_ordering(int dim) {
+    std::vector<Legion::DimensionKind> ordering;
+    ordering.push_back(Legion::DimensionKind::DIM_F); // AOS
+    for (int d = dim - 1; d >= 0; d--)
+      ordering.push_back(
+          static_cast<Legion::DimensionKind>(Legion::DimensionKind::DIM_X + d));
+    return ordering;
+  }
+
+  /*!
+   Dimension ordering of the instances of a task on index spaces of
+   dimension dim, selected by the aos_layout flag of its tag
+  */
+  static std::vector<Legion::DimensionKind>
+  task_ordering(const Legion::Task &task, int dim) {
+    return (task.tag & mapper::aos_layout) ? aos_ordering(dim)
+                                           : soa_ordering(dim);
+  }
+
+  /*!
+   Tag of a task without the layout and stealing flags, selecting its
+   distribution
+  */
+  static Legion::MappingTagID launch_tag(const Legion::Task &task) {
+    return task.tag &
+           ~Legion::MappingTagID(mapper::aos_layout | mapper::stealable);
+  }
+
+  /*!
+   Whether the points of a task may be stolen, selected by the stealable
+   flag of its tag
+  */
+  static bool stealable_launch(const Legion::Task &task) {
+    return (task.tag & mapper::stealable) != 0;
+  }
+
+  /*!
+   Whether the region of a requirement is made of several rects, looked up
+   once per region
+  */
+  bool sparse_region(const Legion::Mapping::MapperContext ctx,
+                     const Legion::RegionRequirement &req) {
+    if (!req.region.exists())
+      return false;
+    auto finder = sparse_regions_.find(req.region);
+    if (finder != sparse_regions_.end())
+      return finder->second;
+    const bool sparse =
+        !runtime->get_index_space_domain(ctx, req.region.get_index_space())
+             .dense();
+    sparse_regions_[req.region] = sparse;
+    return sparse;
+  } // sparse_region
+
+  /*!
+   Returns the constraint set and registered layout id for a layout key.
+   Layouts are built and registered with the runtime once per key and
+   reused by every later mapping call.
+  */
+  const std::pair<Legion::LayoutConstraintID, Legion::LayoutConstraintSet> &
+  find_layout(const Legion::Mapping::MapperContext ctx,
+              const mapper::layout_key_t &key) {
+    auto finder = layouts_.find(key);
+    if (finder != layouts_.end())
+      return finder->second;
+
+    Legion::LayoutConstraintSet layout_constraints;
+    layout_constraints.add_constraint(
+        Legion::OrderingConstraint(key.ordering, true /*contiguous*/));
+    if (key.kind != Realm::Memory::NO_MEMKIND)
+      layout_constraints.add_constraint(Legion::MemoryConstraint(key.kind));
+    if (key.specialization != LEGION_NO_SPECIALIZE) {
+      size_t max_int = size_t(-1) / sizeof(int);
+      layout_constraints.add_constraint(Legion::SpecializedConstraint(
+          key.specialization, 0, false, key.exact, Legion::Domain(),
+          max_int));
+    } // if
+    if (!key.fields.empty())
+      layout_constraints.add_constraint(
+          Legion::FieldConstraint(key.fields, true));
 
     // Do the registration
-    Legion::LayoutConstraintID result =
-        runtime->register_layout(ctx, layout_constraint);
+    Legion::LayoutConstraintID id =
+        runtime->register_layout(ctx, layout_constraints);
+    auto &result = layouts_[key];
+    result.first = id;
+    result.second = layout_constraints;
     return result;
-  }
+  } // find_layout
 
   /*!
    Specialization of the default_policy_select_instance_region methid for FleCSI
@@ -227,109 +541,486 @@ public:
     return variants[0];
   }
 
+  /*!
+   Acquires an instance from the instance cache, without counting the
+   lookup. Entries whose instance has been collected since they were cached
+   are dropped.
+  */
+  bool acquire_cached_instance(const Legion::Mapping::MapperContext ctx,
+                               const mapper::instance_key_t &key,
+                               Legion::Mapping::PhysicalInstance &instance) {
+    const bool hit = instance_cache().find(key, instance) &&
+                     runtime->acquire_instance(ctx, instance);
+    if (!hit)
+      instance_cache().erase(key);
+    return hit;
+  } // acquire_cached_instance
+
+  /*!
+   Counts a lookup of the instance cache as a hit or a miss
+  */
+  void count_lookup(bool hit) {
+    instance_cache().count_lookup(hit);
+    stats_.bump(hit ? stats_.cache_hits : stats_.cache_misses);
+  } // count_lookup
+
+  /*!
+   Adds an instance to the instance cache. Cached instances are protected
+   from garbage collection by the mapper that cached them; once their
+   memory is over budget, the least recently used ones are dropped from
+   the cache and handed back to the garbage collector by that same mapper.
+   Instances of tasks memoized by a live trace are referenced by the
+   recorded trace and pinned until it is retired (see mapper::trace_pins_t);
+   instances of retired regions are left to the collector right away.
+  */
+  void cache_instance(const Legion::Mapping::MapperContext ctx,
+                      const Legion::Task &task,
+                      const mapper::instance_key_t &key,
+                      const Legion::Mapping::PhysicalInstance &instance,
+                      bool created, size_t instance_size) {
+    Legion::TraceID trace = 0;
+    const bool pinned =
+        mapper::trace_pins_t::node_pins().find(task.task_id, trace);
+    Legion::IndexPartition partition = Legion::IndexPartition::NO_PART;
+    if (runtime->has_parent_logical_partition(ctx, key.region))
+      partition = runtime->get_parent_logical_partition(ctx, key.region)
+                      .get_index_partition();
+    const bool cached = instance_cache().insert(
+        key, instance, instance_size, pinned, trace, local_proc, partition);
+    if (!cached)
+      runtime->set_garbage_collection_priority(ctx, instance,
+                                               GC_FIRST_PRIORITY);
+    else if (!created)
+      runtime->set_garbage_collection_priority(ctx, instance,
+                                               GC_NEVER_PRIORITY);
+    release_evicted(ctx);
+  } // cache_instance
+
+  /*!
+   Lowers the priority of the instances this mapper cached that have been
+   evicted since, possibly by the mapper of another processor. Priorities
+   are tracked per mapper, so only the mapper that protected an instance
+   can release it.
+  */
+  void release_evicted(const Legion::Mapping::MapperContext ctx) {
+    std::vector<Legion::Mapping::PhysicalInstance> evicted;
+    instance_cache().take_released(local_proc, evicted);
+    for (auto &inst : evicted)
+      runtime->set_garbage_collection_priority(ctx, inst, GC_FIRST_PRIORITY);
+  } // release_evicted
+
+  /*!
+   Memory CPU instances of a processor are mapped to: its NUMA domain if
+   Realm exposes one, its system memory otherwise
+  */
+  Legion::Memory affine_memory(const Legion::Processor &proc) const {
+    auto p = proc_mem_map.find(proc);
+    if (p != proc_mem_map.end()) {
+      auto m = p->second.find(Realm::Memory::SOCKET_MEM);
+      if (m != p->second.end())
+        return m->second;
+      m = p->second.find(Realm::Memory::SYSTEM_MEM);
+      if (m != p->second.end())
+        return m->second;
+    } // if
+    return local_sysmem;
+  } // affine_memory
+
+  /*!
+   Name of a memory kind in -budget_mb KIND=N
+  */
+  static std::string memory_kind_name(Realm::Memory::Kind kind) {
+    switch (kind) {
+    case Realm::Memory::SOCKET_MEM:
+      return "socket";
+    case Realm::Memory::SYSTEM_MEM:
+      return "sysmem";
+    case Realm::Memory::REGDMA_MEM:
+      return "regdma";
+    case Realm::Memory::Z_COPY_MEM:
+      return "zcopy";
+    case Realm::Memory::GPU_FB_MEM:
+      return "fb";
+    case Realm::Memory::DISK_MEM:
+      return "disk";
+    case Realm::Memory::FILE_MEM:
+      return "file";
+    default:
+      return "other";
+    } // switch
+  } // memory_kind_name
+
+  /*!
+   Memories an instance of a task on proc may be placed in, best first: the
+   preferred memory, then the other memories with affinity to proc from
+   the fastest kind to the slowest. Only memories tasks can address
+   directly are used: disk and file memories would need copies staged
+   through system memory. Memories whose cached instances already fill
+   their budget go after the others.
+  */
+  std::vector<Legion::Memory> placement(const Legion::Processor &proc,
+                                        const Legion::Memory &preferred) const {
+    static const Realm::Memory::Kind kinds[] = {
+        Realm::Memory::SOCKET_MEM, Realm::Memory::SYSTEM_MEM,
+        Realm::Memory::REGDMA_MEM, Realm::Memory::Z_COPY_MEM};
+
+    std::vector<Legion::Memory> memories(1, preferred);
+    auto p = proc_mem_map.find(proc);
+    if (p != proc_mem_map.end())
+      for (Realm::Memory::Kind kind : kinds) {
+        auto m = p->second.find(kind);
+        if (m != p->second.end() && m->second != preferred)
+          memories.push_back(m->second);
+      } // for
+    std::stable_partition(memories.begin(), memories.end(),
+                          [](const Legion::Memory &m) {
+                            return instance_cache().used(m) <
+                                   instance_cache().budget(m);
+                          });
+    return memories;
+  } // placement
+
+  /*!
+   Bytes of an instance holding fields of regions, ignoring layout padding
+  */
+  size_t instance_bytes(const Legion::Mapping::MapperContext ctx,
+                        const std::vector<Legion::LogicalRegion> &regions,
+                        const std::set<Legion::FieldID> &fields) const {
+    size_t bytes = 0;
+    for (const Legion::LogicalRegion &region : regions) {
+      const size_t volume =
+          runtime->get_index_space_domain(ctx, region.get_index_space())
+              .get_volume();
+      for (Legion::FieldID fid : fields)
+        bytes += volume * runtime->get_field_size(
+                              ctx, region.get_field_space(), fid);
+    } // for
+    return bytes;
+  } // instance_bytes
+
+  /*!
+   Places an instance of about bytes in the first of memories where
+   allocate(memory) succeeds. After a failed allocation, unpinned cached
+   instances of the memory are evicted until they freed bytes, those of
+   this mapper first, which are handed back to the garbage collector right
+   away (the others are released by their own mappers on their next
+   mapping call), and the allocation is retried once before falling back
+   to the next memory. Returns the memory of the instance, and aborts if
+   no memory could hold it.
+  */
+  template <typename ALLOCATE>
+  Legion::Memory place_instance(const Legion::Mapping::MapperContext ctx,
+                                const Legion::Task &task,
+                                const std::vector<Legion::Memory> &memories,
+                                size_t indx, size_t bytes,
+                                ALLOCATE &&allocate) {
+    for (const Legion::Memory &memory : memories) {
+      for (int attempt = 0; attempt < 2; attempt++) {
+        if (attempt > 0) {
+          std::vector<Legion::Mapping::PhysicalInstance> evicted;
+          if (instance_cache().trim(memory, bytes, local_proc, evicted) == 0)
+            break;
+          for (auto &inst : evicted)
+            runtime->set_garbage_collection_priority(ctx, inst,
+                                                     GC_FIRST_PRIORITY);
+        } // if
+        const long long start = Realm::Clock::current_time_in_nanoseconds();
+        const bool res = allocate(memory);
+        stats_.bump(stats_.find_or_create_ns,
+                    Realm::Clock::current_time_in_nanoseconds() - start);
+        if (res)
+          return memory;
+      } // for
+      mapper::log_mapper().warning()
+          << "task " << task.get_task_name()
+          << " could not allocate an instance in memory " << memory
+          << " for region requirement #" << indx;
+    } // for
+
+    mapper::log_mapper().fatal()
+        << "task " << task.get_task_name()
+        << " could not allocate an instance in any memory for region "
+           "requirement #"
+        << indx;
+    abort();
+  } // place_instance
+
+  /*!
+   Looks up an instance in the instance cache in any of memories, counting
+   a single miss if none holds it
+  */
+  bool find_placed_instance(const Legion::Mapping::MapperContext ctx,
+                            mapper::instance_key_t key,
+                            const std::vector<Legion::Memory> &memories,
+                            Legion::Mapping::PhysicalInstance &instance) {
+    size_t size;
+    bool hit = false;
+    for (const Legion::Memory &memory : memories) {
+      key.memory = memory;
+      if (instance_cache().contains(key, size) &&
+          acquire_cached_instance(ctx, key, instance)) {
+        hit = true;
+        break;
+      } // if
+    } // for
+    count_lookup(hit);
+    return hit;
+  } // find_placed_instance
+
+  /*!
+   Cache keys of the subregions of point, without their memory. Only
+   requirements on partitions with the identity projection name a
+   point-specific subregion; the others are the same for every point.
+  */
+  std::vector<mapper::instance_key_t>
+  point_keys(const Legion::Mapping::MapperContext ctx,
+             const Legion::Task &task, const Legion::DomainPoint &point) {
+    std::vector<mapper::instance_key_t> keys;
+    for (const Legion::RegionRequirement &req : task.regions) {
+      if (req.handle_type != PART_PROJECTION || req.projection != 0)
+        continue;
+      keys.push_back(
+          {runtime->get_logical_subregion_by_color(ctx, req.partition, point),
+           Legion::Memory::NO_MEMORY, req.privilege_fields,
+           task_ordering(task, region_dim(req))});
+    } // for
+    return keys;
+  } // point_keys
+
+  /*!
+   Bytes of the subregions of a point that are already cached in memory,
+   given the keys of the point (see point_keys)
+  */
+  static size_t cached_bytes(std::vector<mapper::instance_key_t> &keys,
+                             const Legion::Memory &memory) {
+    size_t bytes = 0;
+    for (mapper::instance_key_t &key : keys) {
+      key.memory = memory;
+      size_t size;
+      if (instance_cache().contains(key, size))
+        bytes += size;
+    } // for
+    return bytes;
+  } // cached_bytes
+
+  /*!
+   Sends every point to the local CPU whose affine memory already holds
+   the most bytes of its subregions, cycling through the CPUs sharing that
+   memory. Points with nothing cached anywhere are assigned round-robin.
+   Points of stealable launches stay stealable (see permit_steal_request).
+  */
+  void slice_by_locality(const Legion::Mapping::MapperContext ctx,
+                         const Legion::Task &task,
+                         const Legion::Mapping::Mapper::SliceTaskInput &input,
+                         Legion::Mapping::Mapper::SliceTaskOutput &output) {
+    using namespace Legion;
+
+    std::map<Memory, std::vector<Processor>> memory_cpus;
+    for (const Processor &p : local_cpus)
+      memory_cpus[affine_memory(p)].push_back(p);
+    std::map<Memory, size_t> next_cpu;
+    const bool steal = stealable_launch(task);
+    if (steal)
+      stealable_points() += input.domain.get_volume();
+
+    unsigned local_cpu_index = 0;
+    for (Domain::DomainPointIterator itr(input.domain); itr; itr++) {
+      Memory best = Memory::NO_MEMORY;
+      size_t best_bytes = 0;
+      std::vector<mapper::instance_key_t> keys = point_keys(ctx, task, itr.p);
+      for (auto &m : memory_cpus) {
+        const size_t bytes = cached_bytes(keys, m.first);
+        if (bytes > best_bytes) {
+          best = m.first;
+          best_bytes = bytes;
+        }
+      } // for
+
+      Mapping::Mapper::TaskSlice slice;
+      slice.domain = Domain(itr.p, itr.p);
+      if (best.exists()) {
+        const std::vector<Processor> &cpus = memory_cpus[best];
+        slice.proc = cpus[next_cpu[best]++ % cpus.size()];
+      } else {
+        slice.proc = local_cpus[local_cpu_index++];
+        if (local_cpu_index == local_cpus.size())
+          local_cpu_index = 0;
+      }
+      slice.recurse = false;
+      slice.stealable = steal;
+      output.slices.push_back(slice);
+    } // for
+  } // slice_by_locality
+
+  /*!
+   Address space owning point p of a 1-D launch over [lo, hi], according to
+   the distribution selected by the task tag (see mapper::rank_of)
+  */
+  size_t rank_of(const Legion::Task &task, coord_t p, coord_t lo,
+                 coord_t hi) const {
+    return mapper::rank_of(launch_tag(task), p, lo, hi, rank_procs.size(),
+                           rank_block_size);
+  } // rank_of
+
+  /*!
+   Rank-matched slicing of a 1-D launch. Every contiguous run of points
+   owned by the same remote rank becomes one slice sent to that rank,
+   whose mapper slices it again over its own processors; the points owned
+   by this rank are distributed over the local CPUs right away.
+  */
+  void slice_by_rank(const Legion::Mapping::MapperContext ctx,
+                     const Legion::Task &task,
+                     const Legion::Mapping::Mapper::SliceTaskInput &input,
+                     Legion::Mapping::Mapper::SliceTaskOutput &output) {
+    using namespace Legion;
+
+    // expect a 1-D index domain
+    assert(input.domain.get_dim() == 1);
+    const Rect<1> launch = task.index_domain;
+    const Rect<1> r = input.domain;
+    const size_t local_rank = local_proc.address_space();
+
+    coord_t first = r.lo[0];
+    while (first <= r.hi[0]) {
+      const size_t rank = rank_of(task, first, launch.lo[0], launch.hi[0]);
+      coord_t last = first;
+      while (last < r.hi[0] &&
+             rank_of(task, last + 1, launch.lo[0], launch.hi[0]) == rank)
+        last++;
+
+      if (rank == local_rank) {
+        Mapping::Mapper::SliceTaskInput local_input;
+        local_input.domain = Rect<1>(first, last);
+        slice_by_locality(ctx, task, local_input, output);
+      } else {
+        Mapping::Mapper::TaskSlice slice;
+        slice.domain = Rect<1>(first, last);
+        slice.proc = rank_procs[rank];
+        slice.recurse = (first != last);
+        slice.stealable = false;
+        output.slices.push_back(slice);
+      }
+      first = last + 1;
+    } // while
+  } // slice_by_rank
+
+  /*!
+   Instance cache shared by the mappers of all processors of this address
+   space, with its hit, miss and eviction counters and per-memory usage
+  */
+  static mapper::instance_cache_t &instance_cache() {
+    return mapper::instance_cache_t::node_cache();
+  }
+
+  /*!
+   Accounts for a newly allocated instance and logs it, warning about
+   instances larger than 1 GB
+  */
+  void log_allocation(const Legion::Task &task, const Legion::Memory &memory,
+                      size_t instance_size, size_t indx) {
+    stats_.allocated(memory, instance_size);
+    if (instance_size > 1000000000)
+      mapper::log_mapper().warning()
+          << "task " << task.get_task_name()
+          << " allocates an instance larger than 1 GB (" << instance_size
+          << " bytes) for region requirement #" << indx;
+    else
+      mapper::log_mapper().debug()
+          << "task " << task.get_task_name() << " allocates an instance of "
+          << instance_size << " bytes for region requirement #" << indx;
+  } // log_allocation
+
   /*!
    THis function will create PhysicalInstance for Reduction task
   */
   void creade_reduction_instance(const Legion::Mapping::MapperContext ctx,
                                  const Legion::Task &task,
                                  Legion::Mapping::Mapper::MapTaskOutput &output,
-                                 const Legion::Memory &target_mem,
+                                 const std::vector<Legion::Memory> &memories,
                                  const size_t &indx) {
     // using dummy constraints for REDUCTION
     std::set<Legion::FieldID> dummy_fields;
     Legion::TaskLayoutConstraintSet dummy_constraints;
 
     size_t instance_size = 0;
-    bool res = default_create_custom_instances(
-        ctx, task.target_proc, target_mem, task.regions[indx], indx,
-        dummy_fields, dummy_constraints, false /*need check*/,
-        output.chosen_instances[indx], &instance_size);
-    assert(res);
-
-    std::cout << "task " << task.get_task_name()
-              << " allocates physical instance with size " << instance_size
-              << " for the region requirement #" << indx << std::endl;
-
-    if (instance_size > 1000000000) {
-      std::cout << "task " << task.get_task_name()
-                << " is trying to allocate physical instance with \
-           the size > than 1 Gb("
-                << instance_size << " )"
-                << " for the region requirement # " << indx << std::endl;
-    } // if
+    const size_t bytes =
+        instance_bytes(ctx, {task.regions[indx].region},
+                       task.regions[indx].privilege_fields);
+    const Legion::Memory memory = place_instance(
+        ctx, task, memories, indx, bytes, [&](const Legion::Memory &m) {
+          output.chosen_instances[indx].clear();
+          return default_create_custom_instances(
+              ctx, task.target_proc, m, task.regions[indx], indx,
+              dummy_fields, dummy_constraints, false /*need check*/,
+              output.chosen_instances[indx], &instance_size);
+        });
+
+    log_allocation(task, memory, instance_size, indx);
 
   } // create reduction instance
 
   /*!
-   THis function will create PhysicalInstance Unstructured mesh data havdle (
-    compacted Exclusive, SHared and Ghost)
+   Creates one PhysicalInstance holding the count consecutive requirements
+   starting at indx (see mapper::compacted_count), e.g. the exclusive,
+   shared and ghost parts of unstructured mesh data, or several pieces
+   read by the same task. It holds the fields of all of them and is cached
+   once, under the regions of all of them.
   */
   void create_compacted_instance(
       const Legion::Mapping::MapperContext ctx, const Legion::Task &task,
       Legion::Mapping::Mapper::MapTaskOutput &output,
-      const Legion::Memory &target_mem,
-      const Legion::LayoutConstraintSet &layout_constraints,
-      const size_t &indx) {
+      const std::vector<Legion::Memory> &memories,
+      mapper::layout_key_t layout, const size_t &indx, size_t count) {
     using namespace Legion;
     using namespace Legion::Mapping;
 
-    // check if instance was already created and stored in the
-    // local_instamces_ map
-    const std::pair<Legion::LogicalRegion, Legion::Memory> key1(
-        task.regions[indx].region, target_mem);
-    auto &key2 = task.regions[indx].privilege_fields;
-    instance_map_t::const_iterator finder1 = local_instances_.find(key1);
-    if (finder1 != local_instances_.end()) {
-      const field_instance_map_t &innerMap = finder1->second;
-      field_instance_map_t::const_iterator finder2 = innerMap.find(key2);
-      if (finder2 != innerMap.end()) {
-        for (size_t j = 0; j < 3; j++) {
-          output.chosen_instances[indx + j].clear();
-          output.chosen_instances[indx + j].push_back(finder2->second);
-        } // for
-        return;
-      } // if
-    }   // if
+    assert(task.regions.size() >= indx + count);
+    assert(task.regions[indx].region.exists());
 
-    Legion::Mapping::PhysicalInstance result;
+    std::set<FieldID> fields;
     std::vector<Legion::LogicalRegion> regions;
-    bool created;
-
-    // creating physical instance for the compacted storaged
-    assert(task.regions.size() >= (indx + 2));
-
-    assert(task.regions[indx].region.exists());
+    for (size_t j = 0; j < count; j++) {
+      const RegionRequirement &req = task.regions[indx + j];
+      fields.insert(req.privilege_fields.begin(), req.privilege_fields.end());
+      regions.push_back(req.region);
+    } // for
+    layout.fields.assign(fields.begin(), fields.end());
 
-    // compacting region requirements for exclusive, shared and ghost into one
-    // instance
-    regions.push_back(task.regions[indx].region);
-    regions.push_back(task.regions[indx + 1].region);
-    regions.push_back(task.regions[indx + 2].region);
+    // check if instance was already created and stored in the
+    // instance cache
+    mapper::instance_key_t key{task.regions[indx].region, memories.front(),
+                               fields, layout.ordering};
+    key.group.assign(regions.begin() + 1, regions.end());
+    Legion::Mapping::PhysicalInstance result;
+    if (find_placed_instance(ctx, key, memories, result)) {
+      for (size_t j = 0; j < count; j++) {
+        output.chosen_instances[indx + j].clear();
+        output.chosen_instances[indx + j].push_back(result);
+      } // for
+      return;
+    } // if
 
+    // compacting the requirements into one instance
+    bool created;
     size_t instance_size = 0;
-    auto res = runtime->find_or_create_physical_instance(
-        ctx, target_mem, layout_constraints, regions, result, created,
-        true /*acquire*/, GC_NEVER_PRIORITY, true, &instance_size);
-
-    assert(res);
-
-    std::cout << "task " << task.get_task_name()
-              << " allocates physical instance with size " << instance_size
-              << " for the region requirement #" << indx << std::endl;
-
-    if (instance_size > 1000000000) {
-      std::cout << "task " << task.get_task_name()
-                << " is trying to allocate physical compacted instance with \
-                the size > than 1 Gb("
-                << instance_size << " )"
-                << " for the region requirement # " << indx << std::endl;
-    }
-
-    for (size_t j = 0; j < 3; j++) {
+    key.memory = place_instance(
+        ctx, task, memories, indx, instance_bytes(ctx, regions, fields),
+        [&](const Memory &m) {
+          layout.kind = m.kind();
+          return runtime->find_or_create_physical_instance(
+              ctx, m, find_layout(ctx, layout).second, regions, result,
+              created, true /*acquire*/, GC_NEVER_PRIORITY, true,
+              &instance_size);
+        });
+
+    if (created)
+      log_allocation(task, key.memory, instance_size, indx);
+
+    for (size_t j = 0; j < count; j++) {
       output.chosen_instances[indx + j].clear();
       output.chosen_instances[indx + j].push_back(result);
     } // for
-    local_instances_[key1][key2] = result;
+    cache_instance(ctx, task, key, result, created, instance_size);
   } // create_compacted_instance
 
   /*!
@@ -338,27 +1029,22 @@ public:
   void create_instance(const Legion::Mapping::MapperContext ctx,
                        const Legion::Task &task,
                        Legion::Mapping::Mapper::MapTaskOutput &output,
-                       const Legion::Memory &target_mem,
-                       const Legion::LayoutConstraintSet &layout_constraints,
-                       const size_t &indx) {
+                       const std::vector<Legion::Memory> &memories,
+                       mapper::layout_key_t layout, const size_t &indx) {
     using namespace Legion;
     using namespace Legion::Mapping;
 
     // check if instance was already created and stored in the
-    // local_instamces_ map
-    const std::pair<Legion::LogicalRegion, Legion::Memory> key1(
-        task.regions[indx].region, target_mem);
-    auto key2 = task.regions[indx].privilege_fields;
-    instance_map_t::const_iterator finder1 = local_instances_.find(key1);
-    if (finder1 != local_instances_.end()) {
-      const field_instance_map_t &innerMap = finder1->second;
-      field_instance_map_t::const_iterator finder2 = innerMap.find(key2);
-      if (finder2 != innerMap.end()) {
-        output.chosen_instances[indx].clear();
-        output.chosen_instances[indx].push_back(finder2->second);
-        return;
-      } // if
-    }   // if
+    // instance cache
+    mapper::instance_key_t key{
+        task.regions[indx].region, memories.front(),
+        task.regions[indx].privilege_fields, layout.ordering};
+    Legion::Mapping::PhysicalInstance cached;
+    if (find_placed_instance(ctx, key, memories, cached)) {
+      output.chosen_instances[indx].clear();
+      output.chosen_instances[indx].push_back(cached);
+      return;
+    } // if
 
     Legion::Mapping::PhysicalInstance result;
     std::vector<Legion::LogicalRegion> regions;
@@ -367,26 +1053,21 @@ public:
     regions.push_back(task.regions[indx].region);
 
     size_t instance_size = 0;
-    bool res = runtime->find_or_create_physical_instance(
-        ctx, target_mem, layout_constraints, regions, result, created, true, 0,
-        false, &instance_size);
-
-    assert(res);
-
-    std::cout << "task " << task.get_task_name()
-              << " allocates physical instance with size " << instance_size
-              << " for the region requirement #" << indx << std::endl;
-
-    if (instance_size > 1000000000) {
-      std::cout << "task " << task.get_task_name()
-                << " is trying to allocate physical instance with the size > "
-                   "than 1 Gb("
-                << instance_size << " )"
-                << " for the region requirement # " << indx << std::endl;
-    } // if
+    key.memory = place_instance(
+        ctx, task, memories, indx,
+        instance_bytes(ctx, regions, task.regions[indx].privilege_fields),
+        [&](const Memory &m) {
+          layout.kind = m.kind();
+          return runtime->find_or_create_physical_instance(
+              ctx, m, find_layout(ctx, layout).second, regions, result,
+              created, true, GC_NEVER_PRIORITY, false, &instance_size);
+        });
+
+    if (created)
+      log_allocation(task, key.memory, instance_size, indx);
 
     output.chosen_instances[indx].push_back(result);
-    local_instances_[key1][key2] = result;
+    cache_instance(ctx, task, key, result, created, instance_size);
   } // create_instance
 
   /*!
@@ -423,53 +1104,52 @@ public:
     default_policy_select_target_processors(ctx, task, output.target_procs);
 
     output.chosen_instances.resize(task.regions.size());
+    stats_.bump(stats_.map_task_calls);
+    // a mapped point can no longer be stolen
+    if (task.is_index_space && stealable_launch(task))
+      stealable_points()--;
+    release_evicted(ctx);
 
     if (task.regions.size() > 0) {
 
       for (size_t indx = 0; indx < task.regions.size(); indx++) {
 
-        Legion::LayoutConstraintSet layout_constraints;
-
         Memory target_mem;
 
-        if ((task.tag & mapper::prefer_gpu) && !local_gpus.empty())
+        if (launch_tag(task) == mapper::prefer_gpu && !local_gpus.empty())
           target_mem = local_framebuffer;
         else
-          target_mem = local_sysmem;
-
-        // creating ordering constraint (SOA )
-        std::vector<Legion::DimensionKind> ordering;
-        ordering.push_back(Legion::DimensionKind::DIM_Y);
-        ordering.push_back(Legion::DimensionKind::DIM_X);
-        ordering.push_back(Legion::DimensionKind::DIM_F); // SOA
-        Legion::OrderingConstraint ordering_constraint(ordering,
-                                                       true /*contiguous*/);
-        layout_constraints.add_constraint(ordering_constraint);
-        layout_constraints.add_constraint(
-            Legion::MemoryConstraint(target_mem.kind()));
-        // No specialization
-        size_t max_int = size_t(-1) /  sizeof(int);
-        layout_constraints.add_constraint(Legion::SpecializedConstraint(
-						LEGION_COMPACT_SPECIALIZE, 0, false, false, Domain(), max_int));
-        // Have all the field for the instance available
-        std::vector<Legion::FieldID> all_fields;
-        for (auto fid : task.regions[indx].privilege_fields) {
-          all_fields.push_back(fid);
-        } // for
-        layout_constraints.add_constraint(
-            Legion::FieldConstraint(all_fields, true));
+          target_mem = affine_memory(task.target_proc);
+
+        // memories to fall back to when the target memory is full
+        const std::vector<Memory> memories =
+            placement(task.target_proc, target_mem);
+
+        // SOA ordering in the memory of the instance, compact
+        // specialization and all the fields of the requirement, registered
+        // once per key; requirements flagged exact_pieces on regions made
+        // of several pieces get instances sized exactly to their pieces
+        const mapper::layout_key_t key{
+            target_mem.kind(),
+            std::vector<Legion::FieldID>(
+                task.regions[indx].privilege_fields.begin(),
+                task.regions[indx].privilege_fields.end()),
+            task_ordering(task, region_dim(task.regions[indx])),
+            LEGION_COMPACT_SPECIALIZE,
+            (task.regions[indx].tag & mapper::exact_pieces) != 0 &&
+                sparse_region(ctx, task.regions[indx])};
 
         // creating physical instance for the reduction task
+        const size_t count = mapper::compacted_count(task.regions, indx);
         if (task.regions[indx].privilege == REDUCE) {
-          creade_reduction_instance(ctx, task, output, target_mem, indx);
-        } else if (task.regions[indx].tag == mapper::exclusive_lr) {
+          creade_reduction_instance(ctx, task, output, memories, indx);
+        } else if (count > 1) {
 
-          create_compacted_instance(ctx, task, output, target_mem,
-                                    layout_constraints, indx);
-          indx = indx + 2;
+          create_compacted_instance(ctx, task, output, memories, key, indx,
+                                    count);
+          indx = indx + count - 1;
         } else {
-          create_instance(ctx, task, output, target_mem, layout_constraints,
-                          indx);
+          create_instance(ctx, task, output, memories, key, indx);
         } // end if
         //        } // end if
       } // end for
@@ -480,6 +1160,95 @@ public:
 
   } // map_task
 
+  /*!
+   Memoizes the mapping of every operation launched inside a trace, so
+   that replays of the trace skip map_task entirely. map_task is
+   deterministic for a given task and region, and instances created for
+   memoized tasks, by the mapper of any processor of this address space,
+   are pinned until the application retires the trace, which keeps the
+   replayed mapping valid (see mapper::trace_pins_t).
+
+    @param ctx Mapper Context
+    @param mappable operation launched inside a trace
+    @param input Input information about the trace
+    @param output Output information about memoization
+   */
+  virtual void
+  memoize_operation(const Legion::Mapping::MapperContext ctx,
+                    const Legion::Mappable &mappable,
+                    const Legion::Mapping::Mapper::MemoizeInput &input,
+                    Legion::Mapping::Mapper::MemoizeOutput &output) {
+    const Legion::Task *task = mappable.as_task();
+    if (task != NULL)
+      mapper::trace_pins_t::node_pins().memoize(input.trace_id,
+                                                task->task_id);
+    output.memoize = true;
+  } // memoize_operation
+
+  /*!
+   Control replicates the top-level task, so that every address space
+   launches its own share of the index launches
+  */
+  virtual void
+  select_task_options(const Legion::Mapping::MapperContext ctx,
+                      const Legion::Task &task,
+                      Legion::Mapping::Mapper::TaskOptions &output) {
+    DefaultMapper::select_task_options(ctx, task, output);
+    if (task.get_depth() == 0)
+      output.replicate = rank_procs.size() > 1;
+  } // select_task_options
+
+  /*!
+   Creates one shard per address space, shard a running on the CPU of
+   rank_procs[a], so that shard IDs match the ranks of slice_task and of
+   the rank sharding functors
+  */
+  virtual void map_replicate_task(
+      const Legion::Mapping::MapperContext ctx, const Legion::Task &task,
+      const Legion::Mapping::Mapper::MapTaskInput &input,
+      const Legion::Mapping::Mapper::MapTaskOutput &default_output,
+      Legion::Mapping::Mapper::MapReplicateTaskOutput &output) {
+    output.task_mappings.resize(rank_procs.size(), default_output);
+    output.control_replication_map.resize(rank_procs.size());
+    for (size_t a = 0; a < rank_procs.size(); a++) {
+      // every address space has a CPU, or the launch could not be matched
+      assert(rank_procs[a].exists());
+      output.task_mappings[a].target_procs.assign(1, rank_procs[a]);
+      output.control_replication_map[a] = rank_procs[a];
+    } // for
+  } // map_replicate_task
+
+  /*!
+   Shards rank-matched launches like slice_task distributes them; other
+   launches use the default sharding
+  */
+  virtual void select_sharding_functor(
+      const Legion::Mapping::MapperContext ctx, const Legion::Task &task,
+      const Legion::Mapping::Mapper::SelectShardingFunctorInput &input,
+      Legion::Mapping::Mapper::SelectShardingFunctorOutput &output) {
+    switch (launch_tag(task)) {
+    case mapper::force_rank_match:
+    case mapper::compacted_storage:
+      output.chosen_functor = RANK_MATCH_SHARDING_ID;
+      break;
+    case mapper::rank_block:
+      output.chosen_functor = RANK_BLOCK_SHARDING_ID;
+      break;
+    case mapper::rank_block_cyclic:
+      output.chosen_functor = RANK_BLOCK_CYCLIC_SHARDING_ID;
+      break;
+    default:
+      DefaultMapper::select_sharding_functor(ctx, task, input, output);
+    } // switch
+  } // select_sharding_functor
+
+  /*!
+   Block size of rank_block_cyclic distributions
+  */
+  size_t block_size() const {
+    return rank_block_size;
+  }
+
   virtual void slice_task(const Legion::Mapping::MapperContext ctx,
                           const Legion::Task &task,
                           const Legion::Mapping::Mapper::SliceTaskInput &input,
@@ -489,7 +1258,7 @@ public:
     using namespace Legion::Mapping;
     using namespace mapper;
 
-    switch (task.tag) {
+    switch (launch_tag(task)) {
     case subrank_launch:
       // expect a 1-D index domain
       assert(input.domain.get_dim() == 1);
@@ -500,40 +1269,16 @@ public:
       break;
 
     case force_rank_match:
-    case compacted_storage: {
-      // expect a 1-D index domain - each point goes to the corresponding node
-      assert(input.domain.get_dim() == 1);
-      LegionRuntime::Arrays::Rect<1> r = input.domain.get_rect<1>();
-
-      // go through all the CPU processors and find a representative for each
-      //  node (i.e. address space)
-      std::map<int, Legion::Processor> targets;
-
-      Legion::Machine::ProcessorQuery pq =
-          Legion::Machine::ProcessorQuery(machine).only_kind(
-              Legion::Processor::LOC_PROC);
-      for (Legion::Machine::ProcessorQuery::iterator it = pq.begin();
-           it != pq.end(); ++it) {
-        Legion::Processor p = *it;
-        int a = p.address_space();
-        if (targets.count(a) == 0)
-          targets[a] = p;
-      }
-
-      output.slices.resize(1);
-      for (int a = r.lo[0]; a <= r.hi[0]; a++) {
-        assert(targets.count(a) > 0);
-        output.slices[0].domain = // Legion::Domain::from_rect<1>(
-            Legion::Rect<1>(a, a);
-        output.slices[0].proc = targets[a];
-      }
+    case compacted_storage:
+    case rank_block:
+    case rank_block_cyclic:
+      slice_by_rank(ctx, task, input, output);
       break;
-    }
 
     default:
       // We've already been control replicated, so just divide our points
       // over the local processors, depending on which kind we prefer
-      if (task.tag == mapper::prefer_gpu && !local_gpus.empty()) {
+      if (launch_tag(task) == mapper::prefer_gpu && !local_gpus.empty()) {
         unsigned local_gpu_index = 0;
         for (Domain::DomainPointIterator itr(input.domain); itr; itr++) {
           TaskSlice slice;
@@ -545,7 +1290,9 @@ public:
           slice.stealable = false;
           output.slices.push_back(slice);
         }
-      } else if (task.tag == prefer_omp && !local_omps.empty()) {
+      } else if (launch_tag(task) == prefer_omp && !local_omps.empty()) {
+        if (stealable_launch(task))
+          stealable_points() += input.domain.get_volume();
         unsigned local_omp_index = 0;
         for (Domain::DomainPointIterator itr(input.domain); itr; itr++) {
           TaskSlice slice;
@@ -554,43 +1301,107 @@ public:
           if (local_omp_index == local_omps.size())
             local_omp_index = 0;
           slice.recurse = false;
-          slice.stealable = false;
+          slice.stealable = stealable_launch(task);
           output.slices.push_back(slice);
         }
       } else {
-        // Opt for our cpus instead of our openmap processors
-        unsigned local_cpu_index = 0;
-        for (Domain::DomainPointIterator itr(input.domain); itr; itr++) {
-          TaskSlice slice;
-          slice.domain = Domain(itr.p, itr.p);
-          slice.proc = local_cpus[local_cpu_index++];
-          if (local_cpu_index == local_cpus.size())
-            local_cpu_index = 0;
-          slice.recurse = false;
-          slice.stealable = false;
-          output.slices.push_back(slice);
-        }
+        // Opt for our cpus instead of our openmap processors, preferring
+        // the ones next to the instances of each point
+        slice_by_locality(ctx, task, input, output);
       }
     }
 
   } // slice_task
 
+  /*!
+   While points of stealable launches sliced in this address space wait to
+   be mapped, an idle processor asks the local processors of its own kind
+   for work, those sharing its affine memory first: the instances of their
+   points live in the NUMA domain of the thief. Processors of another
+   memory are only asked if no processor shares it.
+  */
+  virtual void select_steal_targets(
+      const Legion::Mapping::MapperContext ctx,
+      const Legion::Mapping::Mapper::SelectStealingInput &input,
+      Legion::Mapping::Mapper::SelectStealingOutput &output) {
+    using namespace Legion;
+
+    if (stealable_points() <= 0)
+      return;
+    const std::vector<Processor> *peers = &local_cpus;
+    if (local_proc.kind() == Processor::OMP_PROC)
+      peers = &local_omps;
+    else if (local_proc.kind() != Processor::LOC_PROC)
+      return;
+
+    const Memory memory = affine_memory(local_proc);
+    std::vector<Processor> remote_memory;
+    for (const Processor &p : *peers) {
+      if (p == local_proc || input.blacklist.count(p))
+        continue;
+      if (affine_memory(p) == memory)
+        output.targets.insert(p);
+      else
+        remote_memory.push_back(p);
+    } // for
+    if (output.targets.empty())
+      output.targets.insert(remote_memory.begin(), remote_memory.end());
+  } // select_steal_targets
+
+  /*!
+   Gives a thief of this address space up to half of the queued points of
+   stealable launches, those with the most bytes already cached in the
+   affine memory of the thief first
+  */
+  virtual void
+  permit_steal_request(const Legion::Mapping::MapperContext ctx,
+                       const Legion::Mapping::Mapper::StealRequestInput &input,
+                       Legion::Mapping::Mapper::StealRequestOutput &output) {
+    using namespace Legion;
+
+    if (input.thief_proc.address_space() != local_proc.address_space())
+      return;
+    const Memory memory = affine_memory(input.thief_proc);
+    std::vector<std::pair<size_t, const Task *>> candidates;
+    for (const Task *task : input.stealable_tasks)
+      if (stealable_launch(*task)) {
+        std::vector<mapper::instance_key_t> keys =
+            point_keys(ctx, *task, task->index_point);
+        candidates.emplace_back(cached_bytes(keys, memory), task);
+      } // if
+    if (candidates.empty())
+      return;
+
+    std::stable_sort(candidates.begin(), candidates.end(),
+                     [](const std::pair<size_t, const Task *> &a,
+                        const std::pair<size_t, const Task *> &b) {
+                       return a.first > b.first;
+                     });
+    const size_t count = std::max<size_t>(1, candidates.size() / 2);
+    for (size_t i = 0; i < count; i++)
+      output.stolen_tasks.insert(candidates[i].second);
+    stats_.bump(stats_.tasks_stolen, count);
+  } // permit_steal_request
+
 private:
   std::map<Legion::Processor, std::map<Realm::Memory::Kind, Realm::Memory>>
       proc_mem_map;
   Realm::Machine machine;
 
-  // the map of the locac intances that have been already created
-  // the first key is the pair of Logical region and Memory that is
-  // used as an identifier for the instance, second key is fid
-  typedef std::map<std::set<Legion::FieldID>, Legion::Mapping::PhysicalInstance>
-      field_instance_map_t;
+  // counters of this processor, dumped with -mapper_stats
+  mapper::processor_stats_t &stats_;
 
-  typedef std::map<std::pair<Legion::LogicalRegion, Legion::Memory>,
-                   field_instance_map_t>
-      instance_map_t;
+  // points of stealable launches sliced by the mappers of this address
+  // space that were not mapped yet, so processors only ask for work while
+  // there may be some to steal
+  static std::atomic<long> &stealable_points() {
+    static std::atomic<long> points{0};
+    return points;
+  }
 
-  instance_map_t local_instances_;
+  // a CPU of every address space, indexed by address space
+  std::vector<Legion::Processor> rank_procs;
+  size_t rank_block_size = 1;
 
 protected:
   std::map<Legion::TaskID, Legion::VariantID> cpu_variants;
@@ -599,12 +1410,20 @@ protected:
 
   std::vector<Legion::LogicalPartition> indirect_lps;
 
+  // layouts registered with the runtime, by layout key
+  std::map<mapper::layout_key_t,
+           std::pair<Legion::LayoutConstraintID, Legion::LayoutConstraintSet>>
+      layouts_;
+
+  // whether a region is made of several rects, see sparse_region
+  std::map<Legion::LogicalRegion, bool> sparse_regions_;
+
   Legion::Memory local_sysmem, local_zerocopy, local_framebuffer;
 };
 
 /*!
  mapper_registration is used to replace DefaultMapper with mpi_mapper_t in
- FLeCSI
+ FLeCSI, and registers the sharding functors the mapper selects
 
  @ingroup legion-execution
  */
@@ -612,9 +1431,21 @@ protected:
 inline void
 mapper_registration(Legion::Machine machine, Legion::HighLevelRuntime *rt,
                     const std::set<Legion::Processor> &local_procs) {
+  size_t block_size = 1;
   for (std::set<Legion::Processor>::const_iterator it = local_procs.begin();
        it != local_procs.end(); it++) {
     mpi_mapper_t *mapper = new mpi_mapper_t(machine, rt, *it);
+    block_size = mapper->block_size();
     rt->replace_default_mapper(mapper, *it);
   }
+
+  rt->register_sharding_functor(
+      RANK_MATCH_SHARDING_ID,
+      new mapper::rank_sharding_t(mapper::force_rank_match, block_size));
+  rt->register_sharding_functor(
+      RANK_BLOCK_SHARDING_ID,
+      new mapper::rank_sharding_t(mapper::rank_block, block_size));
+  rt->register_sharding_functor(
+      RANK_BLOCK_CYCLIC_SHARDING_ID,
+      new mapper::rank_sharding_t(mapper::rank_block_cyclic, block_size));
 } // mapper registration
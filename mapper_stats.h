@@ -0,0 +1,195 @@
+#pragma once
+
+/*! @file */
+
+#include <legion.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "instance_cache.h"
+
+namespace mapper {
+
+/*!
+ Logger of the mapper, shared by every translation unit including it.
+ Instance allocations are logged at debug level, so builds with a higher
+ OUTPUT_LEVEL compile them out; at run time the level is set with
+ -level mpi_mapper=N.
+ */
+inline Realm::Logger &log_mapper() {
+  static Realm::Logger logger("mpi_mapper");
+  return logger;
+}
+
+/*!
+ Counters of the mapper of one processor. They are bumped on the mapping
+ path with relaxed atomics and only read when the statistics are dumped.
+ */
+struct processor_stats_t {
+  std::atomic<size_t> map_task_calls{0};
+  std::atomic<size_t> cache_hits{0};
+  std::atomic<size_t> cache_misses{0};
+  std::atomic<size_t> instances_created{0};
+  std::atomic<size_t> find_or_create_ns{0};
+  std::atomic<size_t> tasks_stolen{0};
+
+  static void bump(std::atomic<size_t> &counter, size_t n = 1) {
+    counter.fetch_add(n, std::memory_order_relaxed);
+  }
+
+  /*!
+   Records the allocation of an instance of the given size
+   */
+  void allocated(const Legion::Memory &memory, size_t bytes) {
+    bump(instances_created);
+    std::lock_guard<std::mutex> guard(bytes_mutex);
+    bytes_allocated[memory] += bytes;
+  }
+
+  mutable std::mutex bytes_mutex;
+  std::map<Legion::Memory, size_t> bytes_allocated;
+}; // processor_stats_t
+
+/*!
+ Statistics of the mappers of all processors of this address space. They
+ are logged at info level when the last mapper of the address space shuts
+ down and, with -mapper_stats FILE, written to FILE as JSON, together with
+ the counters of the shared instance cache. If the runtime exits without
+ destroying its mappers, the file is written when the process exits.
+ */
+class stats_registry_t {
+public:
+  static stats_registry_t &node_registry() {
+    static stats_registry_t registry;
+    return registry;
+  }
+
+  /*!
+   Counters of the mapper of proc, which reports its shutdown with detach
+   */
+  processor_stats_t &processor(const Legion::Processor &proc) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    std::unique_ptr<processor_stats_t> &stats = stats_[proc];
+    if (!stats)
+      stats.reset(new processor_stats_t);
+    live_++;
+    return *stats;
+  }
+
+  /*!
+   Reports the shutdown of a mapper; the last one logs the statistics and
+   writes them to file
+   */
+  void detach() {
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      if (--live_ > 0)
+        return;
+    }
+    log();
+    dump();
+  } // detach
+
+  /*!
+   Writes the statistics to file at shutdown; only the first call has an
+   effect
+   */
+  void dump_at_exit(const std::string &file) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (!file_.empty())
+      return;
+    file_ = file;
+    // the cache is read by the handler, so it has to be constructed first
+    // to be destroyed after the handler ran
+    instance_cache_t::node_cache();
+    std::atexit([] { node_registry().dump(); });
+  }
+
+  /*!
+   Logs the counters of the cache and the sums over all processors
+   */
+  void log() const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    const instance_cache_t &cache = instance_cache_t::node_cache();
+    size_t calls = 0, created = 0, ns = 0, stolen = 0, bytes = 0;
+    for (auto &p : stats_) {
+      const processor_stats_t &s = *p.second;
+      calls += s.map_task_calls.load();
+      created += s.instances_created.load();
+      ns += s.find_or_create_ns.load();
+      stolen += s.tasks_stolen.load();
+      std::lock_guard<std::mutex> bytes_guard(s.bytes_mutex);
+      for (auto &b : s.bytes_allocated)
+        bytes += b.second;
+    } // for
+    log_mapper().info() << "instance cache: " << cache.hits() << " hits, "
+                        << cache.misses() << " misses, "
+                        << cache.evictions() << " evictions";
+    log_mapper().info() << "mappers: " << calls << " map_task calls, "
+                        << created << " instances created (" << bytes
+                        << " bytes, " << ns << " ns), " << stolen
+                        << " tasks stolen";
+  } // log
+
+  void write_json(FILE *out) const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    const instance_cache_t &cache = instance_cache_t::node_cache();
+    fprintf(out, "{\n  \"instance_cache\": {\"hits\": %zu, \"misses\": %zu, "
+                 "\"evictions\": %zu},\n  \"processors\": [",
+            cache.hits(), cache.misses(), cache.evictions());
+    const char *sep = "\n";
+    for (auto &p : stats_) {
+      const processor_stats_t &s = *p.second;
+      fprintf(out,
+              "%s    {\"processor\": \"%llx\", \"map_task_calls\": %zu, "
+              "\"cache_hits\": %zu, \"cache_misses\": %zu, "
+              "\"instances_created\": %zu, \"find_or_create_ns\": %zu, "
+              "\"tasks_stolen\": %zu, \"bytes_allocated\": {",
+              sep, (unsigned long long)p.first.id, s.map_task_calls.load(),
+              s.cache_hits.load(), s.cache_misses.load(),
+              s.instances_created.load(), s.find_or_create_ns.load(),
+              s.tasks_stolen.load());
+      std::lock_guard<std::mutex> bytes_guard(s.bytes_mutex);
+      const char *mem_sep = "";
+      for (auto &b : s.bytes_allocated) {
+        fprintf(out, "%s\"%llx\": %zu", mem_sep,
+                (unsigned long long)b.first.id, b.second);
+        mem_sep = ", ";
+      } // for
+      fprintf(out, "}}");
+      sep = ",\n";
+    } // for
+    fprintf(out, "\n  ]\n}\n");
+  } // write_json
+
+private:
+  stats_registry_t() = default;
+
+  void dump() {
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      if (file_.empty() || dumped_)
+        return;
+      dumped_ = true;
+    }
+    FILE *out = fopen(file_.c_str(), "w");
+    if (out == NULL)
+      return;
+    write_json(out);
+    fclose(out);
+  } // dump
+
+  mutable std::mutex mutex_;
+  std::map<Legion::Processor, std::unique_ptr<processor_stats_t>> stats_;
+  size_t live_ = 0; // mappers that did not shut down yet
+  std::string file_;
+  bool dumped_ = false;
+}; // stats_registry_t
+
+} // namespace mapper
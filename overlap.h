@@ -0,0 +1,388 @@
+#pragma once
+
+/*! @file */
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+/*!
+ Extent [lo, hi) covered by the owned cells of one mesh color
+ */
+struct piece_extent_t {
+  double lo, hi;
+  size_t color;
+};
+
+/*!
+ Interval search over piece extents. Extents are sorted by their lower
+ bound once; every query is a binary search followed by a scan over the
+ candidates, so finding the k pieces intersecting an interval costs
+ O(log n + k).
+ */
+class piece_search_t {
+public:
+  explicit piece_search_t(std::vector<piece_extent_t> extents)
+      : extents_(std::move(extents)) {
+    std::sort(extents_.begin(), extents_.end(),
+              [](const piece_extent_t &a, const piece_extent_t &b) {
+                return a.lo < b.lo;
+              });
+    // running maximum of the upper bounds keeps the search correct even
+    // when extents overlap each other
+    max_hi_.resize(extents_.size());
+    double max_hi = 0;
+    for (size_t i = 0; i < extents_.size(); i++) {
+      max_hi = (i == 0) ? extents_[i].hi : std::max(max_hi, extents_[i].hi);
+      max_hi_[i] = max_hi;
+    } // for
+  }
+
+  /*!
+   Appends the colors of all pieces intersecting (lo, hi), in order of
+   their lower bound
+   */
+  void query(double lo, double hi, std::vector<size_t> &colors) const {
+    size_t i = std::upper_bound(max_hi_.begin(), max_hi_.end(), lo) -
+               max_hi_.begin();
+    for (; i < extents_.size() && extents_[i].lo < hi; i++) {
+      if (extents_[i].hi > lo)
+        colors.push_back(extents_[i].color);
+    } // for
+  }
+
+private:
+  std::vector<piece_extent_t> extents_;
+  std::vector<double> max_hi_;
+}; // piece_search_t
+
+/*!
+ Estimated cost of remapping every cell of a target mesh, from the extents
+ of the colors of the source and target meshes, both indexed by color,
+ with n_src and n_tgt cells per color. Cells are assumed to be spread
+ evenly over the extent of their color. A target cell costs one plus the
+ number of source cells it intersects, and the first cell of each target
+ color that intersects a source piece also pays piece_cost for reading
+ that piece, since every target color maps the pieces it reads on its
+ own. Target cells are numbered color by color.
+ */
+inline std::vector<double>
+remap_cell_costs(const std::vector<piece_extent_t> &src, size_t n_src,
+                 const std::vector<piece_extent_t> &tgt, size_t n_tgt,
+                 double piece_cost) {
+  const piece_search_t search(src);
+  std::vector<bool> read;
+  std::vector<double> costs;
+  costs.reserve(tgt.size() * n_tgt);
+  std::vector<size_t> colors;
+  for (const piece_extent_t &t : tgt) {
+    const double width = (t.hi - t.lo) / n_tgt;
+    read.assign(src.size(), false);
+    for (size_t i = 0; i < n_tgt; i++) {
+      const double lo = t.lo + i * width, hi = lo + width;
+      double cost = 1;
+      colors.clear();
+      search.query(lo, hi, colors);
+      for (size_t c : colors) {
+        const piece_extent_t &s = src[c];
+        const double cell = (s.hi - s.lo) / n_src;
+        const double first = std::floor((std::max(lo, s.lo) - s.lo) / cell);
+        const double last = std::floor((std::min(hi, s.hi) - s.lo) / cell);
+        cost += std::min(last, double(n_src - 1)) - first + 1;
+        if (!read[c]) {
+          cost += piece_cost;
+          read[c] = true;
+        }
+      } // for
+      costs.push_back(cost);
+    } // for
+  }   // for
+  return costs;
+} // remap_cell_costs
+
+/*!
+ Splits a sequence of cells with the given costs into parts consecutive
+ runs of about equal total cost by walking the prefix sums of the costs:
+ a cell goes to the part its midpoint falls into. Part p is the cells
+ [splits[p], splits[p + 1]), and every part gets at least one cell.
+ */
+inline std::vector<size_t> balanced_splits(const std::vector<double> &costs,
+                                           size_t parts) {
+  assert(parts > 0 && costs.size() >= parts);
+  double total = 0;
+  for (double c : costs)
+    total += c;
+
+  std::vector<size_t> splits(parts + 1);
+  splits[0] = 0;
+  splits[parts] = costs.size();
+  double sum = 0;
+  size_t i = 0;
+  for (size_t p = 1; p < parts; p++) {
+    const double target = total * p / parts;
+    // leave at least one cell to this part and to every later one
+    const size_t max_i = costs.size() - (parts - p);
+    while (i < max_i && (i <= splits[p - 1] || sum + costs[i] / 2 < target))
+      sum += costs[i++];
+    splits[p] = i;
+  } // for
+  return splits;
+} // balanced_splits
+
+/*!
+ Axis-aligned box of N dimensions
+ */
+template <int N> struct box_t {
+  double lo[N], hi[N];
+
+  bool intersects(const box_t &other) const {
+    for (int d = 0; d < N; d++)
+      if (!(lo[d] < other.hi[d] && other.lo[d] < hi[d]))
+        return false;
+    return true;
+  }
+
+  void extend(const box_t &other) {
+    for (int d = 0; d < N; d++) {
+      lo[d] = std::min(lo[d], other.lo[d]);
+      hi[d] = std::max(hi[d], other.hi[d]);
+    } // for
+  }
+}; // box_t
+
+/*!
+ Node of a bounding volume hierarchy: the boxes order[begin, end) and,
+ unless a leaf (left == 0), the children left and left + 1
+ */
+template <int N> struct bvh_node_t {
+  box_t<N> bounds;
+  size_t begin, end;
+  size_t left;
+};
+
+/*!
+ Appends the indices of all boxes intersecting box, in no particular
+ order, from the flat nodes and box order of a hierarchy (see bvh_t) with
+ its root at nodes[0]. boxes(i) returns box i, so the boxes can be read
+ from wherever they live.
+ */
+template <int N, typename BOXES>
+void bvh_query(const bvh_node_t<N> *nodes, const size_t *order,
+               const BOXES &boxes, const box_t<N> &box,
+               std::vector<size_t> &ids) {
+  std::vector<size_t> stack(1, 0);
+  while (!stack.empty()) {
+    const bvh_node_t<N> &node = nodes[stack.back()];
+    stack.pop_back();
+    if (!node.bounds.intersects(box))
+      continue;
+    if (node.left == 0) {
+      for (size_t i = node.begin; i < node.end; i++)
+        if (boxes(order[i]).intersects(box))
+          ids.push_back(order[i]);
+      continue;
+    } // if
+    stack.push_back(node.left);
+    stack.push_back(node.left + 1);
+  } // while
+} // bvh_query
+
+/*!
+ Bounding volume hierarchy over the boxes of unstructured cells, which
+ unlike the cells of a structured run are in no particular order. It is
+ built top-down by splitting the boxes of every node at the median of
+ their centers along the longest axis of the node, down to leaves of at
+ most leaf_size boxes, so a query finding the k boxes intersecting a box
+ costs O(log n + k) for well-shaped cells. Boxes are identified by their
+ index in the vector the hierarchy was built from. The nodes and the box
+ order are flat arrays, at most max_nodes(n) and n long, so they can be
+ stored elsewhere and queried with bvh_query.
+ */
+template <int N> class bvh_t {
+public:
+  static constexpr size_t leaf_size = 8;
+
+  /*!
+   Upper bound on the number of nodes of a hierarchy over n boxes
+   */
+  static size_t max_nodes(size_t n) {
+    return (n == 0) ? 0 : 2 * n - 1;
+  }
+
+  explicit bvh_t(std::vector<box_t<N>> boxes) : boxes_(std::move(boxes)) {
+    order_.resize(boxes_.size());
+    for (size_t i = 0; i < order_.size(); i++)
+      order_[i] = i;
+    if (boxes_.empty())
+      return;
+    nodes_.resize(1);
+    build(0, 0, boxes_.size());
+  }
+
+  const std::vector<bvh_node_t<N>> &nodes() const {
+    return nodes_;
+  }
+
+  const std::vector<size_t> &order() const {
+    return order_;
+  }
+
+  /*!
+   Appends the indices of all boxes intersecting box, in no particular
+   order
+   */
+  void query(const box_t<N> &box, std::vector<size_t> &ids) const {
+    if (nodes_.empty())
+      return;
+    bvh_query(nodes_.data(), order_.data(),
+              [this](size_t i) -> const box_t<N> & { return boxes_[i]; }, box,
+              ids);
+  } // query
+
+private:
+  void build(size_t index, size_t begin, size_t end) {
+    bvh_node_t<N> node{boxes_[order_[begin]], begin, end, 0};
+    for (size_t i = begin + 1; i < end; i++)
+      node.bounds.extend(boxes_[order_[i]]);
+    if (end - begin <= leaf_size) {
+      nodes_[index] = node;
+      return;
+    } // if
+
+    int axis = 0;
+    for (int d = 1; d < N; d++)
+      if (node.bounds.hi[d] - node.bounds.lo[d] >
+          node.bounds.hi[axis] - node.bounds.lo[axis])
+        axis = d;
+    const size_t mid = begin + (end - begin) / 2;
+    std::nth_element(order_.begin() + begin, order_.begin() + mid,
+                     order_.begin() + end, [&](size_t a, size_t b) {
+                       return boxes_[a].lo[axis] + boxes_[a].hi[axis] <
+                              boxes_[b].lo[axis] + boxes_[b].hi[axis];
+                     });
+
+    // children are stored next to each other, the left one first
+    node.left = nodes_.size();
+    nodes_[index] = node;
+    nodes_.resize(nodes_.size() + 2);
+    build(node.left, begin, mid);
+    build(node.left + 1, mid, end);
+  } // build
+
+  std::vector<box_t<N>> boxes_;
+  std::vector<size_t> order_;
+  std::vector<bvh_node_t<N>> nodes_;
+}; // bvh_t
+
+/*!
+ Finds the cells of a sorted run that intersect (lo, hi) by binary search.
+ Returns false if there are none, otherwise [first, last] is the inclusive
+ range of intersecting cells.
+ */
+inline bool cell_range(const double *xmin, const double *xmax, size_t n,
+                       double lo, double hi, size_t &first, size_t &last) {
+  first = std::upper_bound(xmax, xmax + n, lo) - xmax;
+  const size_t end = std::lower_bound(xmin, xmin + n, hi) - xmin;
+  if (first >= end)
+    return false;
+  last = end - 1;
+  return true;
+} // cell_range
+
+/*!
+ Remembers the per-color extents of both meshes an overlap was computed
+ with. Overlaps are computed with every target extent padded by the
+ tolerance, so they remain a superset of the true overlap as long as no
+ cell of either mesh moved by more than half of it. The motion of the
+ cells is measured by the caller, as the largest drift of a cell of every
+ color since the color was last recorded; dirty_colors reports the target
+ colors whose overlap it may have invalidated.
+ */
+class overlap_tracker_t {
+public:
+  explicit overlap_tracker_t(double tolerance = 0) : tolerance_(tolerance) {}
+
+  double tolerance() const {
+    return tolerance_;
+  }
+
+  /*!
+   Whether a cell drift invalidates the overlaps computed before it
+   */
+  bool moved(double drift) const {
+    return 2 * drift > tolerance_;
+  }
+
+  /*!
+   Returns the target colors whose overlap has to be recomputed for the
+   current extents and drifts of the colors of both meshes; all of them if
+   nothing was recorded yet
+   */
+  std::vector<size_t> dirty_colors(const std::vector<piece_extent_t> &src,
+                                   const std::vector<piece_extent_t> &tgt,
+                                   const std::vector<double> &src_drift,
+                                   const std::vector<double> &tgt_drift) const {
+    std::vector<size_t> colors;
+    if (tgt_.size() != tgt.size() || src_.size() != src.size()) {
+      for (size_t t = 0; t < tgt.size(); t++)
+        colors.push_back(t);
+      return colors;
+    } // if
+
+    std::vector<bool> dirty(tgt.size(), false);
+    for (size_t t = 0; t < tgt.size(); t++)
+      dirty[t] = moved(tgt_drift[t]);
+
+    // a moving source color invalidates every target color it may have
+    // overlapped, before or after the motion
+    std::vector<piece_extent_t> padded(tgt_);
+    for (auto &e : padded) {
+      e.lo -= tolerance_;
+      e.hi += tolerance_;
+    } // for
+    const piece_search_t search(std::move(padded));
+    std::vector<size_t> hits;
+    for (size_t s = 0; s < src.size(); s++) {
+      if (!moved(src_drift[s]))
+        continue;
+      search.query(std::min(src_[s].lo, src[s].lo),
+                   std::max(src_[s].hi, src[s].hi), hits);
+    } // for
+    for (size_t t : hits)
+      dirty[t] = true;
+
+    for (size_t t = 0; t < tgt.size(); t++)
+      if (dirty[t])
+        colors.push_back(t);
+    return colors;
+  } // dirty_colors
+
+  /*!
+   Records the extents the overlaps of the given target colors were just
+   recomputed with. Every source color that moved is recorded as well,
+   since all target colors it affects were reported dirty.
+   */
+  void update(const std::vector<piece_extent_t> &src,
+              const std::vector<piece_extent_t> &tgt,
+              const std::vector<double> &src_drift,
+              const std::vector<size_t> &colors) {
+    if (tgt_.size() != tgt.size() || src_.size() != src.size()) {
+      src_ = src;
+      tgt_ = tgt;
+      return;
+    } // if
+    for (size_t s = 0; s < src.size(); s++)
+      if (moved(src_drift[s]))
+        src_[s] = src[s];
+    for (size_t t : colors)
+      tgt_[t] = tgt[t];
+  } // update
+
+private:
+  double tolerance_;
+  std::vector<piece_extent_t> src_;
+  std::vector<piece_extent_t> tgt_;
+}; // overlap_tracker_t
@@ -1,10 +1,20 @@
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <cstdio>
 #include <cstdlib>
+#include <deque>
 #include <legion.h>
+#include <map>
+#include <memory>
 #include <mpi.h>
+#include <set>
+#include <string>
+#include <type_traits>
 
 #include "mapper.h"
+#include "overlap.h"
+#include "remap_kernels.h"
 
 using namespace Legion;
 
@@ -13,365 +23,2613 @@ enum TaskIDs {
   INIT_SMALL_TASK_ID,
   INIT_LARGE_TASK_ID,
   FILL_PART_TASK_ID,
+  BUILD_BVH_TASK_ID,
   REMAP_TASK_ID,
+  UPDATE_TASK_ID,
+  BOUNDS_TASK_ID,
+  MOVE_MESH_TASK_ID,
+  MOTION_TASK_ID,
+  PUSH_REMAP_TASK_ID,
+  GHOST_TASK_ID,
+  NUM_TASK_IDS,
 };
 
-enum FieldIDs { FID, PART_FID1, PART_FID2, PART_FID3, PART_FID4 };
+// The tasks of DIM-dimensional meshes are registered once per mesh
+// dimension, at their ID plus (DIM - 1) * NUM_TASK_IDS
+template <int DIM> static TaskID dim_task(TaskID id) {
+  return id + (DIM - 1) * NUM_TASK_IDS;
+}
 
-void top_level_task(const Task *, const std::vector<PhysicalRegion> &,
-                    Context ctx, Runtime *runtime) {
+enum TraceIDs { REMAP_TRACE_ID = 1 };
 
-  printf("Top level task\n");
-  //------------------------------------------------------------------------
-  // creating data for the small mesh
-  //------------------------------------------------------------------------
+static Realm::Logger log_remap("remap");
 
-  const size_t num_elmts_small = 64;
-  const size_t num_ghosts_small = 2;
-  const size_t num_colors_small = 4;
+enum FieldIDs {
+  FID,
+  XMIN_FID,
+  XMAX_FID,
+  RECT_FID,
+  BVH_NODE_FID,
+  BVH_ORDER_FID,
+  XMIN_REF_FID,
+  XMAX_REF_FID,
+  VALUE_FID_BASE = 16
+};
 
-  Rect<1> color_bounds_small(0, num_colors_small - 1);
+// Remapped field k of a mesh: FID, then VALUE_FID_BASE + k for the others
+static FieldID value_fid(size_t k) {
+  return (k == 0) ? FieldID(FID) : FieldID(VALUE_FID_BASE + k);
+}
 
-  IndexSpaceT<1> color_is_small =
-      runtime->create_index_space(ctx, color_bounds_small);
-  size_t max_size_small = size_t(-1) / (num_colors_small * sizeof(int));
+// Layout of one DIM-dimensional mesh in the blis index space, of dimension
+// DIM + 1: every color owns a slab made of a row of num_elmts cells along
+// the first axis followed by num_ghosts ghost slots, times num_cross cells
+// along each further axis. The slabs of all colors tile [0, 1]^DIM
+// uniformly and their cells carry num_fields remapped values. Cells only
+// move along the first axis, so their bounds along it are stored once per
+// first-axis line, at index 0 of the other axes (see mesh_t::axis_lr).
+struct mesh_args_t {
+  size_t num_elmts;
+  size_t num_ghosts;
+  size_t num_colors;
+  size_t num_fields;
+  size_t num_cross;
+};
 
-  Rect<2> rect_blis_small(
-      Legion::Point<2>(0, 0),
-      Legion::Point<2>(num_colors_small - 1, max_size_small - 1));
+struct remap_args_t {
+  mesh_args_t small;
+  mesh_args_t large;
+};
 
-  IndexSpace is_blis_small = runtime->create_index_space(ctx, rect_blis_small);
+// Arguments of the overlap searches: the extent of every target color is
+// padded on both sides before it is intersected with the source pieces.
+// With bvh, every target cell is searched for in the BVHs over the cells
+// of the source colors instead, see find_overlaps.
+struct part_args_t {
+  remap_args_t meshes;
+  double padding;
+  bool bvh;
+};
 
-  FieldSpace fs_blis_small = runtime->create_field_space(ctx);
-  {
-    FieldAllocator allocator =
-        runtime->create_field_allocator(ctx, fs_blis_small);
-    allocator.allocate_field(sizeof(size_t), FID);
-  }
+// Arguments of the mesh motion, see moving_node
+struct move_args_t {
+  mesh_args_t mesh;
+  double amplitude;
+  double phase;
+};
 
-  LogicalRegion small_lr =
-      runtime->create_logical_region(ctx, is_blis_small, fs_blis_small);
+// Problem sizes and benchmark settings, read from the command line:
+//   -ns/-gs/-cs  elements, ghosts and colors of the small mesh
+//   -nl/-gl/-cl  elements, ghosts and colors of the large mesh
+//   -dim D       dimension of the meshes, 1 to 3
+//   -xs/-xl      cells of the small and large mesh along every axis but
+//                the first, which the colors split
+//   -steps N     number of traced remap steps
+//   -physics     update the small mesh before every remap step
+//   -omp         run the init and remap tasks on OpenMP processors
+//   -steal       let idle processors steal queued points of the remap
+//                launches, whose cost varies with the overlapped pieces
+//   -fields N    number of fields remapped together
+//   -layout aos|soa  instance layout of the mesh kernels
+//   -mode pull|push  remap by pulling the overlapped source pieces into
+//                    every target color (default), or by pushing the
+//                    contributions of every source color into the target
+//                    with a sum reduction
+//   -move A      move the nodes of the large mesh by up to A cells per step
+//   -tol T       motion, in cells of the large mesh, tolerated before the
+//                overlap of a color is recomputed
+//   -balance cost|uniform  split the large mesh for the pull remap into
+//                          runs of cells of equal estimated remap cost,
+//                          or into its colors (default)
+//   -overlap sorted|bvh  search the overlaps by bisection of the sorted
+//                        cells of every color (default), or through a BVH
+//                        over the cells of every source color, which makes
+//                        no assumption on their order
+//   -bench weak|strong|all  sweep the color counts by powers of two up to
+//                           -scale, keeping either the elements per color
+//                           (weak) or the total elements (strong) fixed
+//   -reps N      remap steps timed per configuration
+//   -csv FILE    write the benchmark results to FILE instead of stdout
+// Malformed or missing values are reported and the program exits; unknown
+// flags are reported and ignored.
+struct remap_config_t {
+  size_t num_elmts_small = 64;
+  size_t num_ghosts_small = 2;
+  size_t num_colors_small = 4;
+  size_t num_elmts_large = 100;
+  size_t num_ghosts_large = 4;
+  size_t num_colors_large = 9;
+  size_t dim = 1;
+  size_t num_cross_small = 8;
+  size_t num_cross_large = 6;
+
+  size_t num_steps = 1;
+  bool physics = false;
+  bool omp = false;
+  bool steal = false;
+  bool push = false;
+  size_t num_fields = 1;
+  bool aos = false;
+  double move_amplitude = 0;
+  double tolerance = 1;
+  bool bvh_overlap = false;
+  bool balance = false;
+
+  bool bench_weak = false;
+  bool bench_strong = false;
+  size_t bench_scale = 8;
+  size_t bench_reps = 3;
+  std::string csv_file;
+};
 
-  Legion::Transform<2, 1> ret;
-  ret.rows[0].x = 1;
-  ret.rows[1].x = 0;
+// Regions and partitions of one mesh in the blis layout
+struct mesh_t {
+  mesh_args_t args;
+  IndexSpaceT<1> color_is;
+  IndexSpace is;
+  FieldSpace fs;
+  LogicalRegion lr;
+  LogicalPartition lp; // one row per color
+  IndexSpace single_color_is;
+  LogicalRegion all_lr; // bounding box of the rows in use
+
+  // the cell bounds only vary along the first axis, so they are only
+  // mapped on the first-axis lines of the rows in use, at index 0 of the
+  // other axes; axis_lp holds the line of every row (see axis_partition)
+  LogicalRegion axis_lr;
+  LogicalPartition axis_lp;
+
+  // every row split into the owned cells no other color ghosts, the owned
+  // cells ghosted by a neighbour and the ghost slots; neighbors_lp holds
+  // the shared cells the ghosts of every color mirror (see create_ghosts).
+  // Only created for the mesh whose ghosts are exchanged.
+  LogicalPartition exclusive_lp, shared_lp, ghost_lp, neighbors_lp;
+};
 
-  Rect<2> extend_small(
-      Legion::Point<2>(0, 0),
-      Legion::Point<2>(0, num_elmts_small + num_ghosts_small - 1));
+// Aliased partition of the small mesh by the colors of the large mesh,
+// together with the rect lists it is the image of. The rect lists persist
+// across steps and only the colors reported by the tracker are recomputed
+// after the meshes moved. Every color remaps the owned cells of its color
+// of target_lp: either the rows of the large mesh, or runs of cells of
+// about equal remap cost spanning one or more rows (see create_targets).
+struct overlap_t {
+  IndexPartition target_ip; // only if balanced
+  LogicalPartition target_lp;
+  LogicalPartition target_axis_lp; // bounds of target_lp
+  IndexSpace is_rects;
+  FieldSpace fs_rects;
+  LogicalRegion rects_lr;
+  IndexPartition rects_ip; // one row of rects per color
+  bool bvh = false;        // search engine, see part_args_t
+  IndexSpace is_bvh;       // one BVH per source color, only with bvh
+  FieldSpace fs_bvh;
+  LogicalRegion bvh_lr;
+  IndexPartition bvh_ip;
+  overlap_tracker_t tracker;
+  IndexPartition ip;
+  LogicalPartition lp;
+  LogicalPartition axis_lp; // bounds of lp
+};
 
-  IndexPartition small_ip = runtime->create_partition_by_restriction(
-      ctx, is_blis_small, color_is_small, ret, extend_small,
-      DISJOINT_COMPLETE_KIND);
+// Aliased partition of the large mesh by the colors of the small mesh used
+// by the push-style remap: every color holds the owned cells of the rows of
+// the large mesh that its extent, padded by the tolerance, intersects. It
+// is computed from the extents of both meshes, without any image, and
+// rebuilt whenever the tracker reports motion beyond the tolerance.
+struct push_t {
+  overlap_tracker_t tracker;
+  IndexPartition ip;
+  LogicalPartition lp;
+  LogicalPartition axis_lp; // bounds of lp
+};
 
-  LogicalPartition small_lp =
-      runtime->get_logical_partition(small_lr, small_ip);
+// Wall-clock time of the phases of one run, in seconds
+struct remap_timing_t {
+  double create = 0;
+  double init = 0;
+  double overlap = 0;
+  double remap = 0;
+  size_t overlap_rebuilds = 0;
+};
 
-  ArgumentMap idx_arg_map;
-  IndexLauncher init_small_launcher(INIT_SMALL_TASK_ID, color_is_small,
-                                    TaskArgument(NULL, 0), idx_arg_map);
-  init_small_launcher.add_region_requirement(
-      RegionRequirement(small_lp, 0, WRITE_DISCARD, EXCLUSIVE, small_lr));
-  init_small_launcher.region_requirements[0].add_field(FID);
-  runtime->execute_index_space(ctx, init_small_launcher);
+//------------------------------------------------------------------------
+// Reports a malformed command line and exits
+static void config_error(const std::string &message) {
+  log_remap.error() << message;
+  exit(1);
+} // config_error
+
+//------------------------------------------------------------------------
+// Value of a flag taking a count; the whole value must be a number
+static size_t parse_size(const std::string &flag, const char *value) {
+  char *end;
+  const unsigned long long n = std::strtoull(value, &end, 10);
+  if (*value == '\0' || *value == '-' || *end != '\0')
+    config_error("invalid value '" + std::string(value) + "' of " + flag);
+  return n;
+} // parse_size
+
+//------------------------------------------------------------------------
+// Value of a flag taking a real number; the whole value must be a number
+static double parse_real(const std::string &flag, const char *value) {
+  char *end;
+  const double x = std::strtod(value, &end);
+  if (*value == '\0' || *end != '\0')
+    config_error("invalid value '" + std::string(value) + "' of " + flag);
+  return x;
+} // parse_real
+
+//------------------------------------------------------------------------
+// Index of the value of a flag among its choices
+static size_t parse_choice(const std::string &flag, const char *value,
+                           const std::vector<std::string> &choices) {
+  for (size_t k = 0; k < choices.size(); k++)
+    if (choices[k] == value)
+      return k;
+  std::string expected;
+  for (const std::string &choice : choices)
+    expected += (expected.empty() ? "" : "|") + choice;
+  config_error("invalid value '" + std::string(value) + "' of " + flag +
+               ", expected " + expected);
+  return 0;
+} // parse_choice
+
+//------------------------------------------------------------------------
+// Flags of the runtime and of the mapper are left to them: those of the
+// runtime modules contain a colon, the others are listed here. Values of
+// such flags are skipped as well; any other flag is reported and ignored.
+static bool runtime_flag(const std::string &arg) {
+  static const std::set<std::string> flags = {
+      "-level",          "-logfile",         "-cache_budget_mb",
+      "-budget_mb",      "-rank_block_size", "-mapper_stats"};
+  return arg.find(':') != std::string::npos || flags.count(arg) > 0;
+} // runtime_flag
+
+//------------------------------------------------------------------------
+static remap_config_t parse_config() {
+  remap_config_t config;
+  const InputArgs &args = Runtime::get_input_args();
+  for (int i = 1; i < args.argc; i++) {
+    const std::string arg(args.argv[i]);
+    if (arg.empty() || arg[0] != '-' || runtime_flag(arg))
+      continue;
+    if (arg == "-physics") {
+      config.physics = true;
+      continue;
+    }
+    if (arg == "-omp") {
+      config.omp = true;
+      continue;
+    }
+    if (arg == "-steal") {
+      config.steal = true;
+      continue;
+    }
+    size_t *size = NULL;
+    double *real = NULL;
+    std::vector<std::string> choices;
+    if (arg == "-ns")
+      size = &config.num_elmts_small;
+    else if (arg == "-gs")
+      size = &config.num_ghosts_small;
+    else if (arg == "-cs")
+      size = &config.num_colors_small;
+    else if (arg == "-nl")
+      size = &config.num_elmts_large;
+    else if (arg == "-gl")
+      size = &config.num_ghosts_large;
+    else if (arg == "-cl")
+      size = &config.num_colors_large;
+    else if (arg == "-dim")
+      size = &config.dim;
+    else if (arg == "-xs")
+      size = &config.num_cross_small;
+    else if (arg == "-xl")
+      size = &config.num_cross_large;
+    else if (arg == "-steps")
+      size = &config.num_steps;
+    else if (arg == "-fields")
+      size = &config.num_fields;
+    else if (arg == "-scale")
+      size = &config.bench_scale;
+    else if (arg == "-reps")
+      size = &config.bench_reps;
+    else if (arg == "-move")
+      real = &config.move_amplitude;
+    else if (arg == "-tol")
+      real = &config.tolerance;
+    else if (arg == "-bench")
+      choices = {"weak", "strong", "all"};
+    else if (arg == "-layout")
+      choices = {"soa", "aos"};
+    else if (arg == "-balance")
+      choices = {"cost", "uniform"};
+    else if (arg == "-mode")
+      choices = {"pull", "push"};
+    else if (arg == "-overlap")
+      choices = {"sorted", "bvh"};
+    else if (arg != "-csv") {
+      log_remap.warning() << "ignoring unknown flag " << arg;
+      continue;
+    }
+
+    if (i + 1 >= args.argc)
+      config_error("missing value of " + arg);
+    const char *value = args.argv[++i];
+    if (size != NULL)
+      *size = parse_size(arg, value);
+    else if (real != NULL)
+      *real = parse_real(arg, value);
+    else if (arg == "-csv")
+      config.csv_file = value;
+    else {
+      const size_t k = parse_choice(arg, value, choices);
+      if (arg == "-bench") {
+        config.bench_weak = (k != 1);
+        config.bench_strong = (k != 0);
+      } else if (arg == "-layout")
+        config.aos = (k == 1);
+      else if (arg == "-balance")
+        config.balance = (k == 0);
+      else if (arg == "-mode")
+        config.push = (k == 1);
+      else
+        config.bvh_overlap = (k == 1);
+    }
+  } // for
+
+  if (config.num_elmts_small == 0 || config.num_colors_small == 0 ||
+      config.num_elmts_large == 0 || config.num_colors_large == 0)
+    config_error("meshes need at least one color and one element per color");
+  if (config.num_ghosts_small > config.num_elmts_small ||
+      config.num_ghosts_large > config.num_elmts_large)
+    config_error("meshes need at least as many elements as ghosts per color");
+  if (config.dim < 1 || config.dim > 3)
+    config_error("-dim must be 1, 2 or 3");
+  if (config.num_cross_small == 0 || config.num_cross_large == 0)
+    config_error("-xs and -xl must be positive");
+  if (config.num_steps == 0 || config.bench_reps == 0)
+    config_error("-steps and -reps must be positive");
+  if (config.num_fields == 0)
+    config_error("-fields must be positive");
+  if (!(config.move_amplitude >= 0 && config.tolerance >= 0))
+    config_error("-move and -tol must not be negative");
+  return config;
+} // parse_config
+
+//------------------------------------------------------------------------
+// Waits for all previously issued operations and returns the wall-clock
+// time in seconds
+static double fenced_wtime(Context ctx, Runtime *runtime) {
+  runtime->issue_execution_fence(ctx).get_void_result();
+  return Realm::Clock::current_time_in_microseconds() * 1e-6;
+} // fenced_wtime
 
-  //------------------------------------------------------------------------
-  // creating data for the large mesh
-  //------------------------------------------------------------------------
+//------------------------------------------------------------------------
+// Waits until every operation issued so far has executed, and thus been
+// mapped: mapper state retired afterwards is no longer needed by any of
+// them, and none of their mapper calls can refer to it again
+static void wait_for_issued(Context ctx, Runtime *runtime) {
+  runtime->issue_execution_fence(ctx).get_void_result();
+} // wait_for_issued
 
-  const size_t num_elmts_large = 100;
-  const size_t num_ghosts_large = 4;
-  const size_t num_colors_large = 9;
+//------------------------------------------------------------------------
+// The top-level task is control replicated over the address spaces; only
+// its first shard reports results
+static bool first_shard(Context ctx, Runtime *runtime) {
+  return runtime->get_shard_id(ctx, true /*I know what I am doing*/) == 0;
+} // first_shard
+
+//------------------------------------------------------------------------
+// maps color c onto the slab (c, 0, ..., 0) of a blis index space, or onto
+// its origin if scale is 0
+template <int N>
+static Legion::Transform<N, 1> color_to_row(coord_t scale = 1) {
+  Legion::Transform<N, 1> ret;
+  for (int d = 0; d < N; d++)
+    ret.rows[d].x = (d == 0) ? scale : 0;
+  return ret;
+} // color_to_row
 
-  Rect<1> color_bounds_large(0, num_colors_large - 1);
-  IndexSpaceT<1> color_is_large =
-      runtime->create_index_space(ctx, color_bounds_large);
+//------------------------------------------------------------------------
+// Rect of a blis index space of a DIM-dimensional mesh spanning the colors
+// [c_lo, c_hi], the slots [s_lo, s_hi] along the first axis and all
+// num_cross cells along the others
+template <int DIM>
+static Rect<DIM + 1> slab(coord_t c_lo, coord_t c_hi, coord_t s_lo,
+                          coord_t s_hi, size_t num_cross) {
+  Rect<DIM + 1> rect;
+  rect.lo[0] = c_lo;
+  rect.hi[0] = c_hi;
+  rect.lo[1] = s_lo;
+  rect.hi[1] = s_hi;
+  for (int d = 2; d <= DIM; d++) {
+    rect.lo[d] = 0;
+    rect.hi[d] = num_cross - 1;
+  } // for
+  return rect;
+} // slab
 
-  size_t max_size_large = size_t(-1) / (num_colors_large * sizeof(int));
+//------------------------------------------------------------------------
+// cells of a slab along the axes other than the first
+template <int DIM> static size_t cross_volume(const mesh_args_t &args) {
+  size_t volume = 1;
+  for (int d = 1; d < DIM; d++)
+    volume *= args.num_cross;
+  return volume;
+} // cross_volume
 
-  Rect<2> rect_blis_large(
-      Legion::Point<2>(0, 0),
-      Legion::Point<2>(num_colors_large - 1, max_size_large - 1));
+//------------------------------------------------------------------------
+// Domain made of the union of disjoint rects
+template <int DIM>
+static Domain rects_domain(const std::vector<Rect<DIM + 1>> &rects) {
+  if (rects.empty())
+    return Rect<DIM + 1>::make_empty();
+  if (rects.size() == 1)
+    return rects.front();
+  return DomainT<DIM + 1>(Realm::IndexSpace<DIM + 1, coord_t>(rects));
+} // rects_domain
 
-  IndexSpace is_blis_large = runtime->create_index_space(ctx, rect_blis_large);
+//------------------------------------------------------------------------
+// Partition of a mesh by color from the rects of every color
+template <int DIM>
+static LogicalPartition
+partition_by_rects(Context ctx, Runtime *runtime, const mesh_t &mesh,
+                   const std::vector<std::vector<Rect<DIM + 1>>> &rects,
+                   PartitionKind kind) {
+  std::map<DomainPoint, Domain> domains;
+  for (size_t c = 0; c < rects.size(); c++)
+    domains[DomainPoint(Legion::Point<1>(c))] = rects_domain<DIM>(rects[c]);
+  IndexPartition ip = runtime->create_partition_by_domain(
+      ctx, mesh.is, domains, mesh.color_is, true, kind);
+  return runtime->get_logical_partition(mesh.lr, ip);
+} // partition_by_rects
 
-  FieldSpace fs_blis_large = runtime->create_field_space(ctx);
+//------------------------------------------------------------------------
+// Partition of the first-axis lines of a mesh (see mesh_t::axis_lr) by the
+// colors of partition lp of the mesh, through which the cell bounds of
+// every subregion of lp are accessed
+static LogicalPartition axis_partition(Context ctx, Runtime *runtime,
+                                       const mesh_t &mesh,
+                                       LogicalPartition lp) {
+  IndexPartition ip = runtime->create_partition_by_intersection(
+      ctx, mesh.axis_lr.get_index_space(), lp.get_index_partition());
+  return runtime->get_logical_partition(mesh.axis_lr, ip);
+} // axis_partition
+
+//------------------------------------------------------------------------
+// Splits every row of a mesh into exclusive, shared and ghost slots. The
+// first num_ghosts - num_ghosts / 2 owned cells of a color are ghosted by
+// the upper slots of the previous color and its last num_ghosts / 2 owned
+// cells by the lower slots of the next one (see slot_to_cell); cells
+// ghosted by no color are exclusive. Refreshing the ghosts of a color only
+// reads the shared cells of its neighbours (see launch_ghost_exchange).
+template <int DIM>
+static void create_ghosts(Context ctx, Runtime *runtime, mesh_t &mesh) {
+  const mesh_args_t &args = mesh.args;
+  const coord_t n = args.num_elmts;
+  const coord_t lower = args.num_ghosts / 2;
+  const coord_t upper = args.num_ghosts - lower;
+  // the shared slices of a color must not overlap
+  assert(n >= coord_t(args.num_ghosts));
+
+  const size_t colors = args.num_colors;
+  std::vector<std::vector<Rect<DIM + 1>>> exclusive(colors), shared(colors),
+      ghost(colors), neighbors(colors);
+  for (size_t c = 0; c < colors; c++) {
+    const bool has_prev = c > 0, has_next = c + 1 < colors;
+    const coord_t lo = has_prev ? upper : 0;
+    const coord_t hi = has_next ? n - lower - 1 : n - 1;
+    exclusive[c].push_back(slab<DIM>(c, c, lo, hi, args.num_cross));
+    // cells ghosted by the neighbours, and cells of the neighbours that
+    // the lower and upper ghost slots of this color mirror
+    if (has_prev && upper > 0)
+      shared[c].push_back(slab<DIM>(c, c, 0, upper - 1, args.num_cross));
+    if (has_next && lower > 0)
+      shared[c].push_back(
+          slab<DIM>(c, c, n - lower, n - 1, args.num_cross));
+    if (has_prev && lower > 0)
+      neighbors[c].push_back(
+          slab<DIM>(c - 1, c - 1, n - lower, n - 1, args.num_cross));
+    if (has_next && upper > 0)
+      neighbors[c].push_back(
+          slab<DIM>(c + 1, c + 1, 0, upper - 1, args.num_cross));
+    if (args.num_ghosts > 0)
+      ghost[c].push_back(
+          slab<DIM>(c, c, n, n + args.num_ghosts - 1, args.num_cross));
+  } // for
+
+  mesh.exclusive_lp = partition_by_rects<DIM>(ctx, runtime, mesh, exclusive,
+                                              DISJOINT_INCOMPLETE_KIND);
+  mesh.shared_lp = partition_by_rects<DIM>(ctx, runtime, mesh, shared,
+                                           DISJOINT_INCOMPLETE_KIND);
+  mesh.ghost_lp = partition_by_rects<DIM>(ctx, runtime, mesh, ghost,
+                                          DISJOINT_INCOMPLETE_KIND);
+  mesh.neighbors_lp = partition_by_rects<DIM>(ctx, runtime, mesh, neighbors,
+                                              DISJOINT_INCOMPLETE_KIND);
+} // create_ghosts
+
+//------------------------------------------------------------------------
+// Creates the regions and partitions of a mesh; the ghost partitions are
+// only created with ghosts, for the mesh whose ghosts are exchanged
+template <int DIM>
+static void create_mesh(Context ctx, Runtime *runtime,
+                        const mesh_args_t &args, bool ghosts, mesh_t &mesh) {
+  mesh.args = args;
+
+  Rect<1> color_bounds(0, args.num_colors - 1);
+  mesh.color_is = runtime->create_index_space(ctx, color_bounds);
+  size_t max_size =
+      size_t(-1) / (args.num_colors * cross_volume<DIM>(args) * sizeof(int));
+
+  const Rect<DIM + 1> rect_blis =
+      slab<DIM>(0, args.num_colors - 1, 0, max_size - 1, args.num_cross);
+
+  mesh.is = runtime->create_index_space(ctx, rect_blis);
+
+  mesh.fs = runtime->create_field_space(ctx);
   {
-    FieldAllocator allocator =
-        runtime->create_field_allocator(ctx, fs_blis_large);
-    allocator.allocate_field(sizeof(size_t), FID);
-    allocator.allocate_field(sizeof(Rect<2>), PART_FID1);
-    allocator.allocate_field(sizeof(Rect<2>), PART_FID2);
-    allocator.allocate_field(sizeof(Rect<2>), PART_FID3);
-    allocator.allocate_field(sizeof(Rect<2>), PART_FID4);
+    FieldAllocator allocator = runtime->create_field_allocator(ctx, mesh.fs);
+    for (size_t k = 0; k < args.num_fields; k++)
+      allocator.allocate_field(sizeof(double), value_fid(k));
+    allocator.allocate_field(sizeof(double), XMIN_FID);
+    allocator.allocate_field(sizeof(double), XMAX_FID);
+    // cell bounds the motion checks compare against, see record_bounds
+    allocator.allocate_field(sizeof(double), XMIN_REF_FID);
+    allocator.allocate_field(sizeof(double), XMAX_REF_FID);
   }
 
-  LogicalRegion large_lr =
-      runtime->create_logical_region(ctx, is_blis_large, fs_blis_large);
+  mesh.lr = runtime->create_logical_region(ctx, mesh.is, mesh.fs);
 
-  Rect<2> extend_large(
-      Legion::Point<2>(0, 0),
-      Legion::Point<2>(0, num_elmts_large + num_ghosts_large - 1));
+  const Rect<DIM + 1> extend = slab<DIM>(
+      0, 0, 0, args.num_elmts + args.num_ghosts - 1, args.num_cross);
 
-  IndexPartition large_ip = runtime->create_partition_by_restriction(
-      ctx, is_blis_large, color_is_large, ret, extend_large,
+  IndexPartition ip = runtime->create_partition_by_restriction(
+      ctx, mesh.is, mesh.color_is, color_to_row<DIM + 1>(), extend,
       DISJOINT_COMPLETE_KIND);
 
-  LogicalPartition large_lp =
-      runtime->get_logical_partition(large_lr, large_ip);
+  mesh.lp = runtime->get_logical_partition(mesh.lr, ip);
+
+  // whole-mesh operations are restricted to the bounding box of the used
+  // rows, and those on cell bounds, such as overlap searches, to its
+  // first-axis lines
+  Rect<1> single_color(0, 0);
+  mesh.single_color_is = runtime->create_index_space(ctx, single_color);
+  const Rect<DIM + 1> extend_all =
+      slab<DIM>(0, args.num_colors - 1, 0,
+                args.num_elmts + args.num_ghosts - 1, args.num_cross);
+  IndexPartition all_ip = runtime->create_partition_by_restriction(
+      ctx, mesh.is, mesh.single_color_is, color_to_row<DIM + 1>(0),
+      extend_all, DISJOINT_INCOMPLETE_KIND);
+  mesh.all_lr = runtime->get_logical_subregion_by_color(
+      runtime->get_logical_partition(mesh.lr, all_ip), 0);
+
+  const Rect<DIM + 1> extend_axis = slab<DIM>(
+      0, args.num_colors - 1, 0, args.num_elmts + args.num_ghosts - 1, 1);
+  IndexPartition axis_ip = runtime->create_partition_by_restriction(
+      ctx, mesh.is, mesh.single_color_is, color_to_row<DIM + 1>(0),
+      extend_axis, DISJOINT_INCOMPLETE_KIND);
+  mesh.axis_lr = runtime->get_logical_subregion_by_color(
+      runtime->get_logical_partition(mesh.lr, axis_ip), 0);
+  mesh.axis_lp = axis_partition(ctx, runtime, mesh, mesh.lp);
+
+  if (ghosts)
+    create_ghosts<DIM>(ctx, runtime, mesh);
+} // create_mesh
+
+//------------------------------------------------------------------------
+// Destroys a partition and retires the instances the mapper cached for its
+// subregions, which would otherwise stay pinned for traces that can no
+// longer be replayed (see instance_cache_t). They are only retired once
+// the operations issued on the partition were mapped.
+static void destroy_partition(Context ctx, Runtime *runtime,
+                              IndexPartition ip) {
+  wait_for_issued(ctx, runtime);
+  mapper::instance_cache_t::node_cache().retire_partition(ip);
+  runtime->destroy_index_partition(ctx, ip);
+} // destroy_partition
+
+//------------------------------------------------------------------------
+// Destroys a region tree and retires the instances cached for any of its
+// regions, see destroy_partition
+static void destroy_region(Context ctx, Runtime *runtime, LogicalRegion lr) {
+  wait_for_issued(ctx, runtime);
+  mapper::instance_cache_t::node_cache().retire_tree(lr.get_tree_id());
+  runtime->destroy_logical_region(ctx, lr);
+} // destroy_region
+
+//------------------------------------------------------------------------
+static void destroy_mesh(Context ctx, Runtime *runtime, mesh_t &mesh) {
+  destroy_region(ctx, runtime, mesh.lr);
+  runtime->destroy_field_space(ctx, mesh.fs);
+  runtime->destroy_index_space(ctx, mesh.is);
+  runtime->destroy_index_space(ctx, mesh.color_is);
+  runtime->destroy_index_space(ctx, mesh.single_color_is);
+} // destroy_mesh
+
+//------------------------------------------------------------------------
+// Mapping tag of the launches of the mesh kernels: with -layout aos the
+// mapper lays their instances out AOS
+static MappingTagID layout_tag(const remap_config_t &config) {
+  return config.aos ? mapper::aos_layout : 0;
+} // layout_tag
+
+//------------------------------------------------------------------------
+// Mapping tag of the init and remap launches: with -omp the mapper sends
+// their points to the OpenMP processors, which run the OpenMP variants
+static MappingTagID kernel_tag(const remap_config_t &config) {
+  return layout_tag(config) | (config.omp ? mapper::prefer_omp : 0);
+} // kernel_tag
+
+//------------------------------------------------------------------------
+// Mapping tag of the remap launches: with -steal the mapper lets idle
+// processors steal their queued points
+static MappingTagID remap_tag(const remap_config_t &config,
+                              MappingTagID tag) {
+  return tag | (config.steal ? mapper::stealable : 0);
+} // remap_tag
+
+//------------------------------------------------------------------------
+// task_id is the ID of the task for meshes of the dimension of mesh
+static void init_mesh(Context ctx, Runtime *runtime, TaskID task_id,
+                      const mesh_t &mesh, MappingTagID tag) {
+  ArgumentMap idx_arg_map;
+  IndexLauncher init_launcher(task_id, mesh.color_is,
+                              TaskArgument(&mesh.args, sizeof(mesh.args)),
+                              idx_arg_map);
+  init_launcher.tag = tag;
+  init_launcher.add_region_requirement(
+      RegionRequirement(mesh.lp, 0, WRITE_DISCARD, EXCLUSIVE, mesh.lr));
+  for (size_t k = 0; k < mesh.args.num_fields; k++)
+    init_launcher.region_requirements[0].add_field(value_fid(k));
+  init_launcher.add_region_requirement(
+      RegionRequirement(mesh.axis_lp, 0, WRITE_DISCARD, EXCLUSIVE, mesh.lr));
+  init_launcher.region_requirements[1].add_field(XMIN_FID);
+  init_launcher.region_requirements[1].add_field(XMAX_FID);
+  runtime->execute_index_space(ctx, init_launcher);
+} // init_mesh
+
+//------------------------------------------------------------------------
+// gathers the extent of the owned cells of every color of partition lp of a
+// mesh along the first axis; lp is a partition of its first-axis lines
+// (see axis_partition)
+template <int DIM>
+static void mesh_extents(Context ctx, Runtime *runtime, const mesh_t &mesh,
+                         LogicalPartition lp,
+                         std::vector<piece_extent_t> &extents) {
+  ArgumentMap idx_arg_map;
+  IndexLauncher bounds_launcher(dim_task<DIM>(BOUNDS_TASK_ID), mesh.color_is,
+                                TaskArgument(&mesh.args, sizeof(mesh.args)),
+                                idx_arg_map);
+  bounds_launcher.add_region_requirement(
+      RegionRequirement(lp, 0, READ_ONLY, EXCLUSIVE, mesh.lr));
+  bounds_launcher.region_requirements[0].add_field(XMIN_FID);
+  bounds_launcher.region_requirements[0].add_field(XMAX_FID);
+  FutureMap bounds = runtime->execute_index_space(ctx, bounds_launcher);
+
+  extents.resize(mesh.args.num_colors);
+  for (size_t c = 0; c < mesh.args.num_colors; c++)
+    extents[c] =
+        bounds.get_result<piece_extent_t>(DomainPoint(Legion::Point<1>(c)));
+} // mesh_extents
+
+//------------------------------------------------------------------------
+// Checks the cells of every color of partition lp of the first-axis lines
+// of a mesh for motion, see motion_task
+template <int DIM>
+static IndexLauncher motion_launcher(const mesh_t &mesh, LogicalPartition lp) {
+  IndexLauncher launcher(dim_task<DIM>(MOTION_TASK_ID), mesh.color_is,
+                         TaskArgument(&mesh.args, sizeof(mesh.args)),
+                         ArgumentMap());
+  launcher.add_region_requirement(
+      RegionRequirement(lp, 0, READ_ONLY, EXCLUSIVE, mesh.lr));
+  launcher.region_requirements[0].add_field(XMIN_FID);
+  launcher.region_requirements[0].add_field(XMAX_FID);
+  launcher.region_requirements[0].add_field(XMIN_REF_FID);
+  launcher.region_requirements[0].add_field(XMAX_REF_FID);
+  return launcher;
+} // motion_launcher
+
+//------------------------------------------------------------------------
+// Largest drift of a cell of partition lp of a mesh since it was last
+// recorded (see record_bounds), reduced over all colors into one future,
+// so that a step without motion waits for a single value
+template <int DIM>
+static Future mesh_motion(Context ctx, Runtime *runtime, const mesh_t &mesh,
+                          LogicalPartition lp) {
+  return runtime->execute_index_space(
+      ctx, motion_launcher<DIM>(mesh, lp), LEGION_REDOP_MAX_FLOAT64);
+} // mesh_motion
+
+//------------------------------------------------------------------------
+// Largest drift of a cell of every color of partition lp of a mesh, only
+// gathered once mesh_motion reported motion
+template <int DIM>
+static void color_motion(Context ctx, Runtime *runtime, const mesh_t &mesh,
+                         LogicalPartition lp, std::vector<double> &drifts) {
+  FutureMap motion =
+      runtime->execute_index_space(ctx, motion_launcher<DIM>(mesh, lp));
+  drifts.resize(mesh.args.num_colors);
+  for (size_t c = 0; c < mesh.args.num_colors; c++)
+    drifts[c] = motion.get_result<double>(DomainPoint(Legion::Point<1>(c)));
+} // color_motion
 
-  IndexLauncher init_large_launcher(INIT_LARGE_TASK_ID, color_is_large,
-                                    TaskArgument(NULL, 0), idx_arg_map);
-  init_large_launcher.add_region_requirement(
-      RegionRequirement(large_lp, 0, WRITE_DISCARD, EXCLUSIVE, large_lr));
-  init_large_launcher.region_requirements[0].add_field(FID);
-  runtime->execute_index_space(ctx, init_large_launcher);
+//------------------------------------------------------------------------
+// Records the current cell bounds of the given colors of partition lp of
+// the first-axis lines of a mesh as the reference of later motion checks
+static void record_bounds(Context ctx, Runtime *runtime, const mesh_t &mesh,
+                          LogicalPartition lp,
+                          const std::vector<size_t> &colors) {
+  if (colors.empty())
+    return;
+  std::vector<DomainPoint> points;
+  for (size_t c : colors)
+    points.push_back(DomainPoint(Legion::Point<1>(c)));
+  IndexSpace colors_is = runtime->create_index_space(ctx, points);
+
+  IndexCopyLauncher copy_launcher(colors_is);
+  copy_launcher.add_copy_requirements(
+      RegionRequirement(lp, 0, READ_ONLY, EXCLUSIVE, mesh.lr),
+      RegionRequirement(lp, 0, WRITE_DISCARD, EXCLUSIVE, mesh.lr));
+  copy_launcher.src_requirements[0].add_field(XMIN_FID);
+  copy_launcher.src_requirements[0].add_field(XMAX_FID);
+  copy_launcher.dst_requirements[0].add_field(XMIN_REF_FID);
+  copy_launcher.dst_requirements[0].add_field(XMAX_REF_FID);
+  runtime->issue_copy_operation(ctx, copy_launcher);
+  runtime->destroy_index_space(ctx, colors_is);
+} // record_bounds
 
-  //------------------------------------------------------------------------
-  // create overlaping partition for the small mesh
-  //------------------------------------------------------------------------
+//------------------------------------------------------------------------
+// Brings the overlap partition up to date with the current cell bounds of
+// both meshes. Every call first checks the cells of both meshes for motion
+// beyond the tolerance, which only waits for one reduced future per mesh;
+// only then are the drifts and extents of every color gathered. The rect
+// lists of the colors reported dirty by the tracker are recomputed and the
+// partition is rebuilt from a single image; when no color is dirty the
+// existing partition is kept. Returns true if the partition changed.
+template <int DIM>
+static bool refresh_overlap(Context ctx, Runtime *runtime,
+                            const mesh_t &small, const mesh_t &large,
+                            overlap_t &overlap) {
+  std::vector<double> src_drift, tgt_drift;
+  if (overlap.ip.exists()) {
+    Future src_motion =
+        mesh_motion<DIM>(ctx, runtime, small, small.axis_lp);
+    Future tgt_motion =
+        mesh_motion<DIM>(ctx, runtime, large, overlap.target_axis_lp);
+    if (!overlap.tracker.moved(std::max(src_motion.get_result<double>(),
+                                        tgt_motion.get_result<double>())))
+      return false;
+    color_motion<DIM>(ctx, runtime, small, small.axis_lp, src_drift);
+    color_motion<DIM>(ctx, runtime, large, overlap.target_axis_lp,
+                      tgt_drift);
+  } // if
+
+  std::vector<piece_extent_t> src, tgt;
+  mesh_extents<DIM>(ctx, runtime, small, small.axis_lp, src);
+  mesh_extents<DIM>(ctx, runtime, large, overlap.target_axis_lp, tgt);
+
+  const std::vector<size_t> dirty =
+      overlap.tracker.dirty_colors(src, tgt, src_drift, tgt_drift);
+  if (dirty.empty())
+    return false;
+
+  std::vector<DomainPoint> dirty_points;
+  for (size_t c : dirty)
+    dirty_points.push_back(DomainPoint(Legion::Point<1>(c)));
+  IndexSpace dirty_is = runtime->create_index_space(ctx, dirty_points);
 
-  IndexPartition overlap_ip;
+  ArgumentMap idx_arg_map;
+  const part_args_t part_args = {
+      {small.args, large.args}, overlap.tracker.tolerance(), overlap.bvh};
+
+  LogicalPartition rects_lp =
+      runtime->get_logical_partition(overlap.rects_lr, overlap.rects_ip);
+
+  // the BVH of every source color is built once per rebuild, by its own
+  // point task, and then queried by every dirty target color
+  if (overlap.bvh) {
+    IndexLauncher bvh_launcher(
+        dim_task<DIM>(BUILD_BVH_TASK_ID), small.color_is,
+        TaskArgument(&small.args, sizeof(small.args)), idx_arg_map);
+    bvh_launcher.add_region_requirement(RegionRequirement(
+        runtime->get_logical_partition(overlap.bvh_lr, overlap.bvh_ip), 0,
+        WRITE_DISCARD, EXCLUSIVE, overlap.bvh_lr));
+    bvh_launcher.region_requirements[0].add_field(BVH_NODE_FID);
+    bvh_launcher.region_requirements[0].add_field(BVH_ORDER_FID);
+    bvh_launcher.add_region_requirement(RegionRequirement(
+        small.axis_lp, 0, READ_ONLY, EXCLUSIVE, small.lr));
+    bvh_launcher.region_requirements[1].add_field(XMIN_FID);
+    bvh_launcher.region_requirements[1].add_field(XMAX_FID);
+    runtime->execute_index_space(ctx, bvh_launcher);
+  } // if
+
+  // the rows of the dirty colors are rewritten in place: every row holds
+  // as many rects as any color may overlap (see create_overlap), so no
+  // count of the overlaps is needed first
+  IndexLauncher fill_part_launcher(dim_task<DIM>(FILL_PART_TASK_ID),
+                                   dirty_is,
+                                   TaskArgument(&part_args,
+                                                sizeof(part_args)),
+                                   idx_arg_map);
+  fill_part_launcher.add_region_requirement(RegionRequirement(
+      rects_lp, 0, WRITE_DISCARD, EXCLUSIVE, overlap.rects_lr));
+  fill_part_launcher.region_requirements[0].add_field(RECT_FID);
+  fill_part_launcher.add_region_requirement(RegionRequirement(
+      overlap.target_axis_lp, 0, READ_ONLY, EXCLUSIVE, large.lr));
+  fill_part_launcher.region_requirements[1].add_field(XMIN_FID);
+  fill_part_launcher.region_requirements[1].add_field(XMAX_FID);
+  fill_part_launcher.add_region_requirement(
+      RegionRequirement(small.axis_lr, 0, READ_ONLY, EXCLUSIVE, small.lr));
+  fill_part_launcher.region_requirements[2].add_field(XMIN_FID);
+  fill_part_launcher.region_requirements[2].add_field(XMAX_FID);
+  if (overlap.bvh) {
+    fill_part_launcher.add_region_requirement(RegionRequirement(
+        overlap.bvh_lr, READ_ONLY, EXCLUSIVE, overlap.bvh_lr));
+    fill_part_launcher.region_requirements[3].add_field(BVH_NODE_FID);
+    fill_part_launcher.region_requirements[3].add_field(BVH_ORDER_FID);
+  } // if
+  runtime->execute_index_space(ctx, fill_part_launcher);
+
+  // a single image over all rects of a color gives its overlap
+  if (overlap.ip.exists()) {
+    destroy_partition(ctx, runtime, overlap.axis_lp.get_index_partition());
+    destroy_partition(ctx, runtime, overlap.ip);
+  } // if
+  overlap.ip = runtime->create_partition_by_image_range(
+      ctx, small.is, rects_lp, overlap.rects_lr, RECT_FID, large.color_is,
+      ALIASED_INCOMPLETE_KIND);
+  overlap.lp = runtime->get_logical_partition(small.lr, overlap.ip);
+  overlap.axis_lp = axis_partition(ctx, runtime, small, overlap.lp);
+
+  // the moved source colors and the dirty target colors are measured from
+  // their current bounds from now on, as the tracker records them
+  std::vector<size_t> moved_src;
+  for (size_t s = 0; s < src.size(); s++)
+    if (src_drift.empty() || overlap.tracker.moved(src_drift[s]))
+      moved_src.push_back(s);
+  record_bounds(ctx, runtime, small, small.axis_lp, moved_src);
+  record_bounds(ctx, runtime, large, overlap.target_axis_lp, dirty);
+
+  overlap.tracker.update(src, tgt, src_drift, dirty);
+  runtime->destroy_index_space(ctx, dirty_is);
+  return true;
+} // refresh_overlap
+
+//------------------------------------------------------------------------
+// Chooses the owned cells every color of the large mesh remaps. Without
+// balance they are the rows of the large mesh. With balance, the cells of
+// all rows are taken in order and split into runs of about equal remap
+// cost, estimated from the current extents of the colors of both meshes
+// (see remap_cell_costs): colors reading more source pieces, or denser
+// ones, get fewer cells. A run may span several rows. The split is kept
+// when the meshes move, only the overlaps follow them.
+template <int DIM>
+static void create_targets(Context ctx, Runtime *runtime, const mesh_t &small,
+                           const mesh_t &large, bool balance,
+                           overlap_t &overlap) {
+  // cost of reading a source piece, in target cells: the search of its
+  // overlapped cells and the setup of its weights
+  const double piece_cost = 32;
+
+  overlap.target_ip = IndexPartition::NO_PART;
+  overlap.target_lp = large.lp;
+  overlap.target_axis_lp = large.axis_lp;
+  if (!balance)
+    return;
+
+  std::vector<piece_extent_t> src, tgt;
+  mesh_extents<DIM>(ctx, runtime, small, small.axis_lp, src);
+  mesh_extents<DIM>(ctx, runtime, large, large.axis_lp, tgt);
+  const size_t n_tgt = large.args.num_elmts;
+  const std::vector<size_t> splits = balanced_splits(
+      remap_cell_costs(src, small.args.num_elmts, tgt, n_tgt, piece_cost),
+      large.args.num_colors);
+
+  std::vector<std::vector<Rect<DIM + 1>>> rects(large.args.num_colors);
+  for (size_t c = 0; c < large.args.num_colors; c++) {
+    for (size_t g = splits[c]; g < splits[c + 1];) {
+      const size_t row = g / n_tgt;
+      const size_t end = std::min(splits[c + 1], (row + 1) * n_tgt);
+      rects[c].push_back(slab<DIM>(row, row, g - row * n_tgt,
+                                   end - 1 - row * n_tgt,
+                                   large.args.num_cross));
+      g = end;
+    } // for
+  }   // for
+
+  overlap.target_lp = partition_by_rects<DIM>(ctx, runtime, large, rects,
+                                              DISJOINT_INCOMPLETE_KIND);
+  overlap.target_ip = overlap.target_lp.get_index_partition();
+  overlap.target_axis_lp =
+      axis_partition(ctx, runtime, large, overlap.target_lp);
+} // create_targets
 
+//------------------------------------------------------------------------
+// create overlaping partition for the small mesh; tolerance is the motion
+// of either mesh that the partition absorbs before it is recomputed, and
+// balance selects cost-balanced targets (see create_targets)
+template <int DIM>
+static void create_overlap(Context ctx, Runtime *runtime,
+                           const mesh_t &small, const mesh_t &large,
+                           double tolerance, bool bvh, bool balance,
+                           overlap_t &overlap) {
+  create_targets<DIM>(ctx, runtime, small, large, balance, overlap);
+
+  // one row of overlap rects per color of the large mesh, padded with
+  // empty rects up to the most rects any color may overlap: both searches
+  // find at most one per source color
+  const size_t max_rects = small.args.num_colors;
+  Rect<2> rect_rects(Legion::Point<2>(0, 0),
+                     Legion::Point<2>(large.args.num_colors - 1,
+                                      max_rects - 1));
+  overlap.is_rects = runtime->create_index_space(ctx, rect_rects);
+
+  overlap.fs_rects = runtime->create_field_space(ctx);
   {
-    Rect<2> extend2(Legion::Point<2>(0, 0), Legion::Point<2>(0, 0));
+    FieldAllocator allocator =
+        runtime->create_field_allocator(ctx, overlap.fs_rects);
+    allocator.allocate_field(sizeof(Rect<DIM + 1>), RECT_FID);
+  }
 
-    IndexPartition color_ip = runtime->create_partition_by_restriction(
-        ctx, is_blis_large, color_is_large, ret, extend2,
+  overlap.rects_lr = runtime->create_logical_region(ctx, overlap.is_rects,
+                                                    overlap.fs_rects);
+  overlap.rects_ip = runtime->create_partition_by_restriction(
+      ctx, overlap.is_rects, large.color_is, color_to_row<2>(),
+      Rect<2>(Legion::Point<2>(0, 0), Legion::Point<2>(0, max_rects - 1)),
+      DISJOINT_COMPLETE_KIND);
+  overlap.bvh = bvh;
+  if (bvh) {
+    // one row of flat BVH nodes per source color; the box order of the
+    // color is stored in the first num_elmts slots of the same row
+    const size_t max_nodes = bvh_t<1>::max_nodes(small.args.num_elmts);
+    Rect<2> rect_bvh(Legion::Point<2>(0, 0),
+                     Legion::Point<2>(small.args.num_colors - 1,
+                                      max_nodes - 1));
+    overlap.is_bvh = runtime->create_index_space(ctx, rect_bvh);
+    overlap.fs_bvh = runtime->create_field_space(ctx);
+    {
+      FieldAllocator allocator =
+          runtime->create_field_allocator(ctx, overlap.fs_bvh);
+      allocator.allocate_field(sizeof(bvh_node_t<1>), BVH_NODE_FID);
+      allocator.allocate_field(sizeof(size_t), BVH_ORDER_FID);
+    }
+    overlap.bvh_lr = runtime->create_logical_region(ctx, overlap.is_bvh,
+                                                    overlap.fs_bvh);
+    overlap.bvh_ip = runtime->create_partition_by_restriction(
+        ctx, overlap.is_bvh, small.color_is, color_to_row<2>(),
+        Rect<2>(Legion::Point<2>(0, 0), Legion::Point<2>(0, max_nodes - 1)),
         DISJOINT_COMPLETE_KIND);
+  } // if
+  overlap.tracker = overlap_tracker_t(tolerance);
 
-    LogicalPartition color_lp =
-        runtime->get_logical_partition(large_lr, color_ip);
-
-    // Launch the task that fills PART_FID
-    IndexLauncher fill_part_launcher(FILL_PART_TASK_ID, color_is_large,
-                                     TaskArgument(NULL, 0), idx_arg_map);
-    fill_part_launcher.add_region_requirement(
-        RegionRequirement(color_lp, 0, WRITE_DISCARD, EXCLUSIVE, large_lr));
-    fill_part_launcher.region_requirements[0].add_field(PART_FID1);
-    fill_part_launcher.region_requirements[0].add_field(PART_FID2);
-    fill_part_launcher.region_requirements[0].add_field(PART_FID3);
-    fill_part_launcher.region_requirements[0].add_field(PART_FID4);
-    runtime->execute_index_space(ctx, fill_part_launcher);
-    IndexPartition ip1 = runtime->create_partition_by_image_range(
-        ctx, is_blis_small, color_lp,
-        runtime->get_parent_logical_region(color_lp), PART_FID1, color_is_large,
-        ALIASED_INCOMPLETE_KIND);
-
-    IndexPartition ip2 = runtime->create_partition_by_image_range(
-        ctx, is_blis_small, color_lp,
-        runtime->get_parent_logical_region(color_lp), PART_FID2, color_is_large,
-        ALIASED_INCOMPLETE_KIND);
-
-    IndexPartition ip3 = runtime->create_partition_by_image_range(
-        ctx, is_blis_small, color_lp,
-        runtime->get_parent_logical_region(color_lp), PART_FID3, color_is_large,
-        ALIASED_INCOMPLETE_KIND);
-
-    IndexPartition ip4 = runtime->create_partition_by_image_range(
-        ctx, is_blis_small, color_lp,
-        runtime->get_parent_logical_region(color_lp), PART_FID4, color_is_large,
-        ALIASED_INCOMPLETE_KIND);
-
-    IndexPartition iu1 = runtime->create_partition_by_union(
-        ctx, is_blis_small, ip1, ip2, color_is_large, ALIASED_KIND);
-
-    IndexPartition iu2 = runtime->create_partition_by_union(
-        ctx, is_blis_small, ip3, ip4, color_is_large, ALIASED_KIND);
-
-    overlap_ip = runtime->create_partition_by_union(
-        ctx, is_blis_small, iu1, iu2, color_is_large, ALIASED_COMPLETE_KIND);
-  }
+  refresh_overlap<DIM>(ctx, runtime, small, large, overlap);
+} // create_overlap
 
-  LogicalPartition overlap_lp =
-      runtime->get_logical_partition(small_lr, overlap_ip);
+//------------------------------------------------------------------------
+static void destroy_overlap(Context ctx, Runtime *runtime,
+                            overlap_t &overlap) {
+  if (overlap.target_ip.exists()) {
+    destroy_partition(ctx, runtime,
+                      overlap.target_axis_lp.get_index_partition());
+    destroy_partition(ctx, runtime, overlap.target_ip);
+  } // if
+  destroy_region(ctx, runtime, overlap.rects_lr);
+  runtime->destroy_field_space(ctx, overlap.fs_rects);
+  runtime->destroy_index_space(ctx, overlap.is_rects);
+  if (overlap.bvh) {
+    destroy_region(ctx, runtime, overlap.bvh_lr);
+    runtime->destroy_field_space(ctx, overlap.fs_bvh);
+    runtime->destroy_index_space(ctx, overlap.is_bvh);
+  } // if
+} // destroy_overlap
 
-  //------------------------------------------------------------------------
-  // launch remap task
-  //------------------------------------------------------------------------
-  IndexLauncher remap_launcher(REMAP_TASK_ID, color_is_large,
-                               TaskArgument(NULL, 0), idx_arg_map);
-  remap_launcher.add_region_requirement(
-      RegionRequirement(large_lp, 0, READ_WRITE, EXCLUSIVE, large_lr));
-  remap_launcher.region_requirements[0].add_field(FID);
+//------------------------------------------------------------------------
+static void destroy_push(Context ctx, Runtime *runtime, push_t &push) {
+  destroy_partition(ctx, runtime, push.axis_lp.get_index_partition());
+  destroy_partition(ctx, runtime, push.ip);
+} // destroy_push
 
+//------------------------------------------------------------------------
+// Brings the push partition up to date with the current cell bounds of
+// both meshes. Returns true if the partition changed.
+template <int DIM>
+static bool refresh_push(Context ctx, Runtime *runtime, const mesh_t &small,
+                         const mesh_t &large, push_t &push) {
+  if (push.ip.exists()) {
+    Future src_motion =
+        mesh_motion<DIM>(ctx, runtime, small, small.axis_lp);
+    Future tgt_motion =
+        mesh_motion<DIM>(ctx, runtime, large, large.axis_lp);
+    if (!push.tracker.moved(std::max(src_motion.get_result<double>(),
+                                     tgt_motion.get_result<double>())))
+      return false;
+  } // if
+
+  std::vector<piece_extent_t> src, tgt;
+  mesh_extents<DIM>(ctx, runtime, small, small.axis_lp, src);
+  mesh_extents<DIM>(ctx, runtime, large, large.axis_lp, tgt);
+
+  const double padding = push.tracker.tolerance();
+  const piece_search_t search(tgt);
+  std::map<DomainPoint, Domain> domains;
+  std::vector<size_t> rows;
+  for (const piece_extent_t &e : src) {
+    rows.clear();
+    search.query(e.lo - padding, e.hi + padding, rows);
+    Rect<DIM + 1> rect = Rect<DIM + 1>::make_empty();
+    if (!rows.empty()) {
+      // the large colors overlapping an interval are consecutive slabs
+      const auto minmax = std::minmax_element(rows.begin(), rows.end());
+      rect = slab<DIM>(*minmax.first, *minmax.second, 0,
+                       large.args.num_elmts - 1, large.args.num_cross);
+    }
+    domains[DomainPoint(Legion::Point<1>(e.color))] = rect;
+  } // for
+
+  if (push.ip.exists())
+    destroy_push(ctx, runtime, push);
+  push.ip = runtime->create_partition_by_domain(
+      ctx, large.is, domains, small.color_is, true, ALIASED_INCOMPLETE_KIND);
+  push.lp = runtime->get_logical_partition(large.lr, push.ip);
+  push.axis_lp = axis_partition(ctx, runtime, large, push.lp);
+
+  // the whole partition was rebuilt, so all cells are measured from their
+  // current bounds from now on
+  std::vector<size_t> src_colors, tgt_colors;
+  for (size_t c = 0; c < src.size(); c++)
+    src_colors.push_back(c);
+  for (size_t c = 0; c < tgt.size(); c++)
+    tgt_colors.push_back(c);
+  record_bounds(ctx, runtime, small, small.axis_lp, src_colors);
+  record_bounds(ctx, runtime, large, large.axis_lp, tgt_colors);
+  return true;
+} // refresh_push
+
+//------------------------------------------------------------------------
+template <int DIM>
+static void create_push(Context ctx, Runtime *runtime, const mesh_t &small,
+                        const mesh_t &large, double tolerance, push_t &push) {
+  push.tracker = overlap_tracker_t(tolerance);
+  refresh_push<DIM>(ctx, runtime, small, large, push);
+} // create_push
+
+//------------------------------------------------------------------------
+template <int DIM>
+static void launch_remap(Context ctx, Runtime *runtime, const mesh_t &small,
+                         const mesh_t &large, const overlap_t &overlap,
+                         MappingTagID tag) {
+  const remap_args_t remap_args = {small.args, large.args};
+
+  ArgumentMap idx_arg_map;
+  IndexLauncher remap_launcher(dim_task<DIM>(REMAP_TASK_ID), large.color_is,
+                               TaskArgument(&remap_args, sizeof(remap_args)),
+                               idx_arg_map);
+  remap_launcher.tag = tag;
+  std::vector<RegionRequirement> &reqs = remap_launcher.region_requirements;
+  // the target regions of a color are packed into one instance (see
+  // mapper::compacted_count): balanced targets span rows and are remapped
+  // as they are, rows are remapped through their exclusive, shared and
+  // ghost parts; the ghosts are refreshed once the steps are done (see
+  // launch_ghost_exchange)
+  const MappingTagID target_group = mapper::compact_group(0);
+  if (overlap.target_ip.exists()) {
+    remap_launcher.add_region_requirement(RegionRequirement(
+        overlap.target_lp, 0, READ_WRITE, EXCLUSIVE, large.lr));
+  } else {
+    remap_launcher.add_region_requirement(RegionRequirement(
+        large.exclusive_lp, 0, READ_WRITE, EXCLUSIVE, large.lr));
+    remap_launcher.add_region_requirement(RegionRequirement(
+        large.shared_lp, 0, READ_WRITE, EXCLUSIVE, large.lr));
+    remap_launcher.add_region_requirement(RegionRequirement(
+        large.ghost_lp, 0, READ_ONLY, EXCLUSIVE, large.lr));
+  }
+  for (RegionRequirement &req : reqs) {
+    req.tag = target_group;
+    for (size_t k = 0; k < large.args.num_fields; k++)
+      req.add_field(value_fid(k));
+  } // for
+
+  // the source is addressed piece by piece (see remap_task), so its
+  // instances only need to hold the overlapped pieces
   remap_launcher.add_region_requirement(
-      RegionRequirement(overlap_lp, 0, READ_ONLY, EXCLUSIVE, small_lr));
-  remap_launcher.region_requirements[1].add_field(FID);
+      RegionRequirement(overlap.lp, 0, READ_ONLY, EXCLUSIVE, small.lr));
+  reqs.back().tag = mapper::exact_pieces;
+  for (size_t k = 0; k < large.args.num_fields; k++)
+    reqs.back().add_field(value_fid(k));
+
+  // cell bounds of the source pieces and of the target
+  remap_launcher.add_region_requirement(RegionRequirement(
+      overlap.axis_lp, 0, READ_ONLY, EXCLUSIVE, small.lr));
+  reqs.back().tag = mapper::exact_pieces;
+  remap_launcher.add_region_requirement(RegionRequirement(
+      overlap.target_axis_lp, 0, READ_ONLY, EXCLUSIVE, large.lr));
+  for (size_t r = reqs.size() - 2; r < reqs.size(); r++) {
+    reqs[r].add_field(XMIN_FID);
+    reqs[r].add_field(XMAX_FID);
+  }
+
+  // the rect list the overlap of every color is the image of, which is
+  // the table of the pieces of its source region
+  remap_launcher.add_region_requirement(RegionRequirement(
+      runtime->get_logical_partition(overlap.rects_lr, overlap.rects_ip), 0,
+      READ_ONLY, EXCLUSIVE, overlap.rects_lr));
+  reqs.back().add_field(RECT_FID);
 
   runtime->execute_index_space(ctx, remap_launcher);
-}//top level task
+} // launch_remap
 
 //------------------------------------------------------------------------
-void init_small_task(const Task *task,
-                     const std::vector<PhysicalRegion> &regions, Context ctx,
-                     Runtime *runtime) {
+// Push-style remap: the target values are zeroed, then every color of the
+// small mesh folds its contributions into them with the built-in sum
+// reduction of doubles
+template <int DIM>
+static void launch_push_remap(Context ctx, Runtime *runtime,
+                              const mesh_t &small, const mesh_t &large,
+                              const push_t &push, MappingTagID tag) {
+  for (size_t k = 0; k < large.args.num_fields; k++)
+    runtime->fill_field<double>(ctx, large.all_lr, large.lr, value_fid(k),
+                                0.0);
+
+  const remap_args_t remap_args = {small.args, large.args};
 
-  assert(regions.size() == 1);
-  assert(task->regions.size() == 1);
-  assert(task->regions[0].privilege_fields.size() == 1);
+  ArgumentMap idx_arg_map;
+  IndexLauncher push_launcher(dim_task<DIM>(PUSH_REMAP_TASK_ID),
+                              small.color_is,
+                              TaskArgument(&remap_args, sizeof(remap_args)),
+                              idx_arg_map);
+  push_launcher.tag = tag;
+  push_launcher.add_region_requirement(
+      RegionRequirement(small.lp, 0, READ_ONLY, EXCLUSIVE, small.lr));
+  push_launcher.add_region_requirement(
+      RegionRequirement(push.lp, 0, LEGION_REDOP_SUM_FLOAT64, EXCLUSIVE,
+                        large.lr));
+  for (size_t k = 0; k < large.args.num_fields; k++) {
+    push_launcher.region_requirements[0].add_field(value_fid(k));
+    push_launcher.region_requirements[1].add_field(value_fid(k));
+  }
+
+  // cell bounds of the target and of the source
+  push_launcher.add_region_requirement(
+      RegionRequirement(push.axis_lp, 0, READ_ONLY, EXCLUSIVE, large.lr));
+  push_launcher.add_region_requirement(
+      RegionRequirement(small.axis_lp, 0, READ_ONLY, EXCLUSIVE, small.lr));
+  for (size_t r = 2; r < 4; r++) {
+    push_launcher.region_requirements[r].add_field(XMIN_FID);
+    push_launcher.region_requirements[r].add_field(XMAX_FID);
+  }
+
+  runtime->execute_index_space(ctx, push_launcher);
+} // launch_push_remap
+
+//------------------------------------------------------------------------
+template <int DIM>
+static void launch_update(Context ctx, Runtime *runtime, const mesh_t &mesh,
+                          MappingTagID tag) {
+  ArgumentMap idx_arg_map;
+  IndexLauncher update_launcher(dim_task<DIM>(UPDATE_TASK_ID), mesh.color_is,
+                                TaskArgument(&mesh.args, sizeof(mesh.args)),
+                                idx_arg_map);
+  update_launcher.tag = tag;
+  update_launcher.add_region_requirement(
+      RegionRequirement(mesh.lp, 0, READ_WRITE, EXCLUSIVE, mesh.lr));
+  for (size_t k = 0; k < mesh.args.num_fields; k++)
+    update_launcher.region_requirements[0].add_field(value_fid(k));
+  runtime->execute_index_space(ctx, update_launcher);
+} // launch_update
+
+//------------------------------------------------------------------------
+// Refreshes the ghost slots of every color of a mesh from the shared cells
+// of its neighbours, the only data that moves between colors
+template <int DIM>
+static void launch_ghost_exchange(Context ctx, Runtime *runtime,
+                                  const mesh_t &mesh, MappingTagID tag) {
+  if (mesh.args.num_ghosts == 0)
+    return;
+  ArgumentMap idx_arg_map;
+  IndexLauncher ghost_launcher(dim_task<DIM>(GHOST_TASK_ID), mesh.color_is,
+                               TaskArgument(&mesh.args, sizeof(mesh.args)),
+                               idx_arg_map);
+  ghost_launcher.tag = tag;
+  ghost_launcher.add_region_requirement(RegionRequirement(
+      mesh.ghost_lp, 0, WRITE_DISCARD, EXCLUSIVE, mesh.lr));
+  ghost_launcher.add_region_requirement(RegionRequirement(
+      mesh.neighbors_lp, 0, READ_ONLY, EXCLUSIVE, mesh.lr));
+  for (size_t k = 0; k < mesh.args.num_fields; k++) {
+    ghost_launcher.region_requirements[0].add_field(value_fid(k));
+    ghost_launcher.region_requirements[1].add_field(value_fid(k));
+  }
+  runtime->execute_index_space(ctx, ghost_launcher);
+} // launch_ghost_exchange
+
+//------------------------------------------------------------------------
+template <int DIM>
+static void launch_move(Context ctx, Runtime *runtime, const mesh_t &mesh,
+                        double amplitude, double phase) {
+  const move_args_t move_args = {mesh.args, amplitude, phase};
+
+  ArgumentMap idx_arg_map;
+  IndexLauncher move_launcher(dim_task<DIM>(MOVE_MESH_TASK_ID), mesh.color_is,
+                              TaskArgument(&move_args, sizeof(move_args)),
+                              idx_arg_map);
+  move_launcher.add_region_requirement(
+      RegionRequirement(mesh.axis_lp, 0, WRITE_DISCARD, EXCLUSIVE, mesh.lr));
+  move_launcher.region_requirements[0].add_field(XMIN_FID);
+  move_launcher.region_requirements[0].add_field(XMAX_FID);
+  runtime->execute_index_space(ctx, move_launcher);
+} // launch_move
+
+//------------------------------------------------------------------------
+// Unpins the instances the mapper kept for a trace (see
+// mapper::trace_pins_t), once every operation recorded in it was mapped
+static void retire_trace(Context ctx, Runtime *runtime, TraceID trace_id) {
+  wait_for_issued(ctx, runtime);
+  mapper::trace_pins_t::node_pins().retire(trace_id);
+} // retire_trace
+
+//------------------------------------------------------------------------
+// Time-stepping loop: every step optionally moves the large mesh,
+// optionally updates the small mesh and remaps it onto the large one, so
+// every update is consumed by the remap that follows it. The launches of a
+// step are captured in a trace, so that after the first step their
+// dependence analysis and mapping are replayed instead of recomputed.
+// A rebuilt overlap (or push) partition changes the regions the remap
+// reads but not the dependences between the launches of a step, so every
+// run and rebuild recycles the same trace ID: the runtime records a new
+// physical template for the new regions instead of keeping one trace per
+// rebuild. A rebuild retires the trace in the mapper, which unpins the
+// instances it kept for the old regions (see mapper::trace_pins_t).
+// Returns the number of partition rebuilds.
+template <int DIM>
+static size_t run_steps(Context ctx, Runtime *runtime, const mesh_t &small,
+                        const mesh_t &large, overlap_t &overlap,
+                        push_t &push, const remap_config_t &config,
+                        size_t steps) {
+  const TraceID trace_id = REMAP_TRACE_ID;
+  size_t rebuilds = 0;
+  for (size_t step = 0; step < steps; step++) {
+    if (config.move_amplitude > 0) {
+      launch_move<DIM>(ctx, runtime, large, config.move_amplitude,
+                       0.1 * (step + 1));
+      const bool rebuilt =
+          config.push
+              ? refresh_push<DIM>(ctx, runtime, small, large, push)
+              : refresh_overlap<DIM>(ctx, runtime, small, large, overlap);
+      if (rebuilt) {
+        retire_trace(ctx, runtime, trace_id);
+        rebuilds++;
+      }
+    } // if
+
+    runtime->begin_trace(ctx, trace_id);
+    if (config.physics)
+      launch_update<DIM>(ctx, runtime, small, layout_tag(config));
+    if (config.push)
+      launch_push_remap<DIM>(ctx, runtime, small, large, push,
+                             remap_tag(config, layout_tag(config)));
+    else
+      launch_remap<DIM>(ctx, runtime, small, large, overlap,
+                        remap_tag(config, kernel_tag(config)));
+    runtime->end_trace(ctx, trace_id);
+  } // for
+  retire_trace(ctx, runtime, trace_id);
+  return rebuilds;
+} // run_steps
+
+//------------------------------------------------------------------------
+// Runs the whole pipeline once for the given sizes, fencing every phase.
+// The remap time is averaged over the steps.
+template <int DIM>
+static remap_timing_t run_mesh_pipeline(Context ctx, Runtime *runtime,
+                                        const remap_config_t &config,
+                                        size_t steps) {
+  remap_timing_t timing;
+  mesh_t small, large;
+  overlap_t overlap;
+  push_t push;
+
+  const double t_start = fenced_wtime(ctx, runtime);
+
+  // only the ghosts of the large mesh are exchanged, see below
+  create_mesh<DIM>(ctx, runtime,
+                   {config.num_elmts_small, config.num_ghosts_small,
+                    config.num_colors_small, config.num_fields,
+                    config.num_cross_small},
+                   false, small);
+  create_mesh<DIM>(ctx, runtime,
+                   {config.num_elmts_large, config.num_ghosts_large,
+                    config.num_colors_large, config.num_fields,
+                    config.num_cross_large},
+                   true, large);
+  const double t_create = fenced_wtime(ctx, runtime);
+
+  init_mesh(ctx, runtime, dim_task<DIM>(INIT_SMALL_TASK_ID), small,
+            kernel_tag(config));
+  init_mesh(ctx, runtime, dim_task<DIM>(INIT_LARGE_TASK_ID), large,
+            kernel_tag(config));
+  const double t_init = fenced_wtime(ctx, runtime);
+
+  const double cell_large =
+      1.0 / double(config.num_elmts_large * config.num_colors_large);
+  if (config.push)
+    create_push<DIM>(ctx, runtime, small, large,
+                     config.tolerance * cell_large, push);
+  else
+    create_overlap<DIM>(ctx, runtime, small, large,
+                        config.tolerance * cell_large, config.bvh_overlap,
+                        config.balance, overlap);
+  const double t_overlap = fenced_wtime(ctx, runtime);
+
+  timing.overlap_rebuilds = run_steps<DIM>(
+      ctx, runtime, small, large, overlap, push, config, steps);
+  const double t_remap = fenced_wtime(ctx, runtime);
+
+  // no step reads the ghosts of the large mesh, so they are only brought
+  // up to date with the remapped values once, outside the timed steps
+  launch_ghost_exchange<DIM>(ctx, runtime, large, layout_tag(config));
+
+  timing.create = t_create - t_start;
+  timing.init = t_init - t_create;
+  timing.overlap = t_overlap - t_init;
+  timing.remap = (t_remap - t_overlap) / steps;
+
+  if (config.push)
+    destroy_push(ctx, runtime, push);
+  else
+    destroy_overlap(ctx, runtime, overlap);
+  destroy_mesh(ctx, runtime, small);
+  destroy_mesh(ctx, runtime, large);
+  return timing;
+} // run_mesh_pipeline
+
+//------------------------------------------------------------------------
+// Runs the pipeline for meshes of dimension config.dim
+static remap_timing_t run_pipeline(Context ctx, Runtime *runtime,
+                                   const remap_config_t &config,
+                                   size_t steps) {
+  switch (config.dim) {
+  case 1:
+    return run_mesh_pipeline<1>(ctx, runtime, config, steps);
+  case 2:
+    return run_mesh_pipeline<2>(ctx, runtime, config, steps);
+  default:
+    assert(config.dim == 3);
+    return run_mesh_pipeline<3>(ctx, runtime, config, steps);
+  } // switch
+} // run_pipeline
+
+//------------------------------------------------------------------------
+// Sweeps the color counts by powers of two and writes one CSV line per
+// configuration
+static void run_benchmark(Context ctx, Runtime *runtime,
+                          const remap_config_t &config) {
+  FILE *out = first_shard(ctx, runtime) ? stdout : NULL;
+  if (out != NULL && !config.csv_file.empty()) {
+    out = fopen(config.csv_file.c_str(), "w");
+    if (out == NULL)
+      config_error("cannot open " + config.csv_file);
+  }
+
+  if (out != NULL)
+    fprintf(out, "mode,remap,dim,colors_small,elmts_small,colors_large,"
+                 "elmts_large,create_s,init_s,overlap_s,remap_s,"
+                 "remap_cells_per_s\n");
+
+  for (int strong = 0; strong < 2; strong++) {
+    if (strong ? !config.bench_strong : !config.bench_weak)
+      continue;
+    for (size_t factor = 1; factor <= config.bench_scale; factor *= 2) {
+      remap_config_t c = config;
+      c.num_colors_small *= factor;
+      c.num_colors_large *= factor;
+      if (strong) {
+        // keep the total number of elements fixed, as long as every color
+        // still owns at least as many elements as it has ghosts
+        c.num_elmts_small = std::max<size_t>(1, c.num_elmts_small / factor);
+        c.num_elmts_large = std::max<size_t>(1, c.num_elmts_large / factor);
+        if (c.num_ghosts_small > c.num_elmts_small ||
+            c.num_ghosts_large > c.num_elmts_large) {
+          log_remap.warning()
+              << "stopping the strong scaling sweep at " << factor
+              << " times the colors: fewer elements than ghosts per color";
+          break;
+        }
+      }
+
+      const remap_timing_t t = run_pipeline(ctx, runtime, c, c.bench_reps);
+      double cells = double(c.num_elmts_large * c.num_colors_large);
+      for (size_t d = 1; d < c.dim; d++)
+        cells *= c.num_cross_large;
+      if (out == NULL)
+        continue;
+      fprintf(out, "%s,%s,%zu,%zu,%zu,%zu,%zu,%g,%g,%g,%g,%g\n",
+              strong ? "strong" : "weak", c.push ? "push" : "pull", c.dim,
+              c.num_colors_small,
+              c.num_elmts_small, c.num_colors_large, c.num_elmts_large,
+              t.create, t.init, t.overlap, t.remap, cells / t.remap);
+      fflush(out);
+    } // for
+  }   // for
+
+  if (out != NULL && out != stdout)
+    fclose(out);
+} // run_benchmark
+
+//------------------------------------------------------------------------
+void top_level_task(const Task *, const std::vector<PhysicalRegion> &,
+                    Context ctx, Runtime *runtime) {
+
+  const bool report = first_shard(ctx, runtime);
+  if (report)
+    printf("Top level task\n");
+
+  const remap_config_t config = parse_config();
+
+  if (config.bench_weak || config.bench_strong) {
+    run_benchmark(ctx, runtime, config);
+    return;
+  }
+
+  const remap_timing_t t =
+      run_pipeline(ctx, runtime, config, config.num_steps);
+  if (!report)
+    return;
+  printf("%zu-D meshes, small mesh: %zu colors x %zu elements, large "
+         "mesh: %zu colors x %zu elements\n",
+         config.dim, config.num_colors_small, config.num_elmts_small,
+         config.num_colors_large, config.num_elmts_large);
+  if (config.dim > 1)
+    printf("cells along the other axes: small mesh %zu, large mesh %zu\n",
+           config.num_cross_small, config.num_cross_large);
+  printf("%s remap: create %g s, init %g s, overlap %g s, remap %g s per "
+         "step (%zu steps)\n",
+         config.push ? "push" : "pull", t.create, t.init, t.overlap, t.remap,
+         config.num_steps);
+  if (config.move_amplitude > 0)
+    printf("overlap partition rebuilt in %zu of %zu steps\n",
+           t.overlap_rebuilds, config.num_steps);
+} // top level task
+
+//------------------------------------------------------------------------
+// Global index of the cell stored in slot i of a color: owned cells come
+// first, followed by ghost copies of the neighbouring cells, half on each
+// side. Ghosts past the domain boundary map outside [0, num_cells).
+static coord_t slot_to_cell(const mesh_args_t &mesh, coord_t color,
+                            coord_t i) {
+  const coord_t num_elmts = mesh.num_elmts;
+  const coord_t half_ghosts = mesh.num_ghosts / 2;
+  if (i < num_elmts)
+    return color * num_elmts + i;
+  if (i - num_elmts < half_ghosts)
+    return color * num_elmts - half_ghosts + (i - num_elmts);
+  return (color + 1) * num_elmts + (i - num_elmts - half_ghosts);
+} // slot_to_cell
+
+//------------------------------------------------------------------------
+// Whether a task runs on an OpenMP processor, i.e. is the OpenMP variant
+// and may spread its loops over the threads of the processor
+static bool on_omp_proc(const Task *task) {
+  return task->current_proc.kind() == Processor::OMP_PROC;
+} // on_omp_proc
+
+//------------------------------------------------------------------------
+// Owned cells of a region of a mesh with num_elmts owned cells per color,
+// one rect per row in the order of the rows. The region may span several
+// rows (see create_targets); ghost slots are left out.
+template <int DIM>
+static std::vector<Rect<DIM + 1>> owned_rows(Context ctx, Runtime *runtime,
+                                             LogicalRegion region,
+                                             size_t num_elmts) {
+  std::vector<Rect<DIM + 1>> rows;
+  const Domain domain =
+      runtime->get_index_space_domain(ctx, region.get_index_space());
+  for (RectInDomainIterator<DIM + 1> rid(domain); rid(); rid++) {
+    Rect<DIM + 1> rect = *rid;
+    rect.hi[1] = std::min<coord_t>(rect.hi[1], coord_t(num_elmts) - 1);
+    for (coord_t row = rect.lo[0]; row <= rect.hi[0] && !rect.empty();
+         row++) {
+      rows.push_back(rect);
+      rows.back().lo[0] = rows.back().hi[0] = row;
+    } // for
+  }   // for
+  std::sort(rows.begin(), rows.end(),
+            [](const Rect<DIM + 1> &a, const Rect<DIM + 1> &b) {
+              return a.lo[0] < b.lo[0];
+            });
+  return rows;
+} // owned_rows
+
+//------------------------------------------------------------------------
+// Line of a rect along the first axis of the mesh (dimension 1 of the blis
+// index space) at its lowest color and cross cells
+template <int N> static Rect<N> axis_line(Rect<N> rect) {
+  for (int d = 0; d < N; d++)
+    if (d != 1)
+      rect.hi[d] = rect.lo[d];
+  return rect;
+} // axis_line
+
+//------------------------------------------------------------------------
+// Field of doubles of a physical region, accessed over rects of a bounding
+// rect. When the instance is affine over the bounds, as the mapper lays
+// instances out, values are accessed in place through raw pointers and
+// their strides. Otherwise, e.g. for bounds spanning several pieces of a
+// compact instance, they are gathered into and scattered from dense copies
+// through a generic accessor. The instance is only looked up once: the
+// view can be moved to other bounds of the same field, e.g. to every piece
+// of a compact instance in turn (see rebound).
+template <PrivilegeMode MODE, int N> class field_view_t {
+public:
+  typedef Realm::AffineAccessor<double, N, coord_t> affine_accessor_t;
+  // values are read-only with READ_ONLY privileges
+  typedef typename std::conditional<MODE == READ_ONLY, const double,
+                                    double>::type value_t;
+
+  field_view_t(const PhysicalRegion &region, FieldID fid,
+               const Rect<N> &bounds)
+      : generic_(region, fid), fid_(fid) {
+    rebound(bounds);
+  }
+
+  // View without bounds yet, to be given with rebound
+  field_view_t(const PhysicalRegion &region, FieldID fid)
+      : generic_(region, fid), fid_(fid) {}
+
+  // Accesses the field over other bounds
+  void rebound(const Rect<N> &bounds) {
+    affine_.reset();
+    if (affine_accessor_t::is_compatible(generic_.accessor.inst, fid_,
+                                         bounds))
+      affine_.reset(
+          new affine_accessor_t(generic_.accessor.inst, fid_, bounds));
+  }
+
+  bool affine() const {
+    return affine_ != nullptr;
+  }
+
+  double operator[](const Legion::Point<N> &p) const {
+    if (affine())
+      return (*affine_)[p];
+    return generic_[p];
+  }
+
+  // Values over rect and their strides along every dimension: in place, or
+  // copy filled in the order of PointInRectIterator
+  value_t *block(const Rect<N> &rect, size_t *strides,
+                 std::vector<double> &copy) const {
+    if (affine()) {
+      for (int d = 0; d < N; d++)
+        strides[d] = affine_->strides[d] / sizeof(double);
+      return affine_->ptr(rect.lo);
+    }
+    copy.resize(rect.volume());
+    size_t k = 0;
+    for (PointInRectIterator<N> pir(rect); pir(); pir++)
+      copy[k++] = generic_[*pir];
+    size_t stride = 1;
+    for (int d = 0; d < N; d++) {
+      strides[d] = stride;
+      stride *= rect.hi[d] - rect.lo[d] + 1;
+    } // for
+    return copy.data();
+  } // block
+
+  // Writes back the values of rect returned by block, if they were copied
+  void store(const Rect<N> &rect, const std::vector<double> &copy) const {
+    if (affine())
+      return;
+    size_t k = 0;
+    for (PointInRectIterator<N> pir(rect); pir(); pir++)
+      generic_[*pir] = copy[k++];
+  } // store
+
+private:
+  FieldAccessor<MODE, double, N> generic_;
+  FieldID fid_;
+  std::unique_ptr<affine_accessor_t> affine_;
+}; // field_view_t
+
+//------------------------------------------------------------------------
+// Values of a field over a line along the first axis of the mesh. Dense
+// lines, the layout the mapper normally picks, are read in place through
+// the raw pointer; lines of strided layouts or of non-affine instances are
+// gathered into copy and the returned pointer refers to copy.
+template <PrivilegeMode MODE, int N>
+static const double *row_values(const field_view_t<MODE, N> &view,
+                                const Rect<N> &rect,
+                                std::vector<double> &copy) {
+  for (int d = 0; d < N; d++)
+    assert(d == 1 || rect.lo[d] == rect.hi[d]);
+  size_t strides[N];
+  const double *ptr = view.block(rect, strides, copy);
+  if (strides[1] == 1)
+    return ptr;
+
+  std::vector<double> line(rect.volume());
+  for (size_t i = 0; i < line.size(); i++)
+    line[i] = ptr[i * strides[1]];
+  copy.swap(line);
+  return copy.data();
+} // row_values
+
+//------------------------------------------------------------------------
+// Values of a field over a row of a two-dimensional index space: in place
+// if the instance is dense along the row, otherwise gathered into copy
+template <typename T>
+static const T *row_data(const PhysicalRegion &region, FieldID fid,
+                         const Rect<2> &row, std::vector<T> &copy) {
+  const FieldAccessor<READ_ONLY, T, 2> generic(region, fid);
+  if (Realm::AffineAccessor<T, 2, coord_t>::is_compatible(
+          generic.accessor.inst, fid, row)) {
+    const FieldAccessor<READ_ONLY, T, 2, coord_t,
+                        Realm::AffineAccessor<T, 2, coord_t>>
+        affine(region, fid, row);
+    size_t strides[2];
+    const T *ptr = affine.ptr(row, strides);
+    if (strides[1] == 1)
+      return ptr;
+  } // if
+  copy.clear();
+  copy.reserve(row.volume());
+  for (PointInRectIterator<2> pir(row); pir(); pir++)
+    copy.push_back(generic[*pir]);
+  return copy.data();
+} // row_data
+
+//------------------------------------------------------------------------
+// Values of a field over a rect, with the strides of the axes of the mesh,
+// i.e. of every dimension of the blis index space but the color; see
+// field_view_t::block
+template <int DIM, PrivilegeMode MODE>
+static typename field_view_t<MODE, DIM + 1>::value_t *
+mesh_ptr(const field_view_t<MODE, DIM + 1> &view, const Rect<DIM + 1> &rect,
+         size_t *stride, std::vector<double> &copy) {
+  size_t strides[DIM + 1];
+  auto ptr = view.block(rect, strides, copy);
+  std::copy(strides + 1, strides + DIM + 1, stride);
+  return ptr;
+} // mesh_ptr
+
+//------------------------------------------------------------------------
+// Writes values and cell bounds for every slot of one color of a uniform
+// mesh; field k holds the value of FID plus k. Slots of ghosts past the
+// domain boundary are degenerate and hold zero. Values and bounds only
+// depend on the first axis, so every line of slots along it is written
+// alike; the bounds in regions[1] only hold the first line.
+template <int DIM>
+static Rect<DIM + 1> init_mesh_piece(const Task *task,
+                                     const std::vector<PhysicalRegion> &regions,
+                                     Context ctx, Runtime *runtime,
+                                     double scale) {
+
+  assert(regions.size() == 2);
+  assert(task->regions.size() == 2);
+  assert(task->arglen == sizeof(mesh_args_t));
+
+  const mesh_args_t &mesh = *static_cast<const mesh_args_t *>(task->args);
+  assert(task->regions[0].privilege_fields.size() == mesh.num_fields);
+  assert(task->regions[1].privilege_fields.size() == 2);
+  const coord_t num_elmts = mesh.num_elmts;
+  const coord_t num_cells = num_elmts * mesh.num_colors;
+
+  typedef field_view_t<WRITE_DISCARD, DIM + 1> wd_view_t;
 
   auto color = task->index_point.point_data[0];
-  const FieldAccessor<WRITE_DISCARD, size_t, 2> acc(regions[0], FID);
-  auto rect = runtime->get_index_space_domain(
+
+  // value and bounds of slot i
+  auto init_slot = [&](coord_t i, double &val, double &xmin, double &xmax) {
+    const coord_t g = slot_to_cell(mesh, color, i);
+    if (g < 0 || g >= num_cells) {
+      val = 0;
+      xmin = xmax = (g < 0) ? 0.0 : 1.0;
+      return;
+    } // if
+    uniform_cell(g, num_cells, xmin, xmax);
+    val = scale * (g / num_elmts);
+  };
+
+  Rect<DIM + 1> rect = runtime->get_index_space_domain(
       ctx, task->regions[0].region.get_index_space());
-  for (PointInRectIterator<2> pir(rect); pir(); pir++) {
-    acc[*pir] = 4 * color;
-  }
+  const bool parallel = on_omp_proc(task);
+  const coord_t lo = rect.lo[1], hi = rect.hi[1];
+  const wd_view_t acc(regions[0], FID, rect);
+  const Rect<DIM + 1> axis = axis_line(rect);
+  const wd_view_t acc_xmin(regions[1], XMIN_FID, axis);
+  const wd_view_t acc_xmax(regions[1], XMAX_FID, axis);
+
+  // the bounds of the first line are kept, those computed alongside the
+  // values of the other lines are dropped
+  size_t axis_strides[2][DIM + 1];
+  std::vector<double> axis_copies[2];
+  double *axis_xmin = acc_xmin.block(axis, axis_strides[0], axis_copies[0]);
+  double *axis_xmax = acc_xmax.block(axis, axis_strides[1], axis_copies[1]);
+  std::vector<double> dropped[2];
+  for (int k = 0; k < 2; k++)
+    dropped[k].resize(hi - lo + 1);
+
+  // one line of slots per row and cell of the other axes
+  Rect<DIM + 1> starts = rect;
+  starts.hi[1] = lo;
+  for (PointInRectIterator<DIM + 1> sir(starts); sir(); sir++) {
+    Rect<DIM + 1> line(*sir, *sir);
+    line.hi[1] = hi;
+    size_t strides[3][DIM + 1];
+    std::vector<double> val_copy;
+    double *val = acc.block(line, strides[0], val_copy);
+    const bool first = line.lo == axis.lo;
+    double *xmin = first ? axis_xmin : dropped[0].data();
+    double *xmax = first ? axis_xmax : dropped[1].data();
+    strides[1][1] = first ? axis_strides[0][1] : 1;
+    strides[2][1] = first ? axis_strides[1][1] : 1;
+
+    if (strides[0][1] == 1 && strides[1][1] == 1 && strides[2][1] == 1) {
+      // dense lines: raw pointers the compiler can vectorize
+#ifdef _OPENMP
+#pragma omp parallel for if (parallel)
+#endif
+      for (coord_t i = lo; i <= hi; i++)
+        init_slot(i, val[i - lo], xmin[i - lo], xmax[i - lo]);
+    } else {
+#ifdef _OPENMP
+#pragma omp parallel for if (parallel)
+#endif
+      for (coord_t i = lo; i <= hi; i++)
+        init_slot(i, val[(i - lo) * strides[0][1]],
+                  xmin[(i - lo) * strides[1][1]],
+                  xmax[(i - lo) * strides[2][1]]);
+    }
+    acc.store(line, val_copy);
+
+    for (size_t k = 1; k < mesh.num_fields; k++) {
+      const wd_view_t acc_k(regions[0], value_fid(k), line);
+      size_t strides_k[DIM + 1];
+      std::vector<double> copy_k;
+      double *val_k = acc_k.block(line, strides_k, copy_k);
+#ifdef _OPENMP
+#pragma omp parallel for if (parallel)
+#endif
+      for (coord_t i = 0; i <= hi - lo; i++)
+        val_k[i * strides_k[1]] = val[i * strides[0][1]] + k;
+      acc_k.store(line, copy_k);
+    } // for
+  }   // for
+  acc_xmin.store(axis, axis_copies[0]);
+  acc_xmax.store(axis, axis_copies[1]);
+
+  return rect;
+} // init_mesh_piece
+
+//------------------------------------------------------------------------
+template <int DIM>
+void init_small_task(const Task *task,
+                     const std::vector<PhysicalRegion> &regions, Context ctx,
+                     Runtime *runtime) {
+
+  auto rect = init_mesh_piece<DIM>(task, regions, ctx, runtime, 4);
 
-  std::cout << "IRNA DEBUG rect = " << rect << std::endl;
+  log_remap.debug() << "init small rect = " << rect;
 } // init_small
 
 //------------------------------------------------------------------------
+template <int DIM>
 void init_large_task(const Task *task,
                      const std::vector<PhysicalRegion> &regions, Context ctx,
                      Runtime *runtime) {
 
+  init_mesh_piece<DIM>(task, regions, ctx, runtime, 9);
+
+} // init large
+
+//------------------------------------------------------------------------
+// Rewrites the cell bounds of every slot of the first-axis line of one
+// color from the node positions of a moving mesh, see moving_node
+template <int DIM>
+void move_mesh_task(const Task *task,
+                    const std::vector<PhysicalRegion> &regions, Context ctx,
+                    Runtime *runtime) {
+
   assert(regions.size() == 1);
   assert(task->regions.size() == 1);
-  assert(task->regions[0].privilege_fields.size() == 1);
+  assert(task->regions[0].privilege_fields.size() == 2);
+  assert(task->arglen == sizeof(move_args_t));
+
+  const move_args_t &args = *static_cast<const move_args_t *>(task->args);
+  const coord_t num_cells = args.mesh.num_elmts * args.mesh.num_colors;
 
   auto color = task->index_point.point_data[0];
-  const FieldAccessor<WRITE_DISCARD, size_t, 2> acc(regions[0], FID);
-  auto rect = runtime->get_index_space_domain(
+  const FieldAccessor<WRITE_DISCARD, double, DIM + 1> acc_xmin(regions[0],
+                                                               XMIN_FID);
+  const FieldAccessor<WRITE_DISCARD, double, DIM + 1> acc_xmax(regions[0],
+                                                               XMAX_FID);
+  Rect<DIM + 1> rect = runtime->get_index_space_domain(
       ctx, task->regions[0].region.get_index_space());
-  for (PointInRectIterator<2> pir(rect); pir(); pir++) {
-    acc[*pir] = 9 * color;
-  }
+  for (PointInRectIterator<DIM + 1> pir(rect); pir(); pir++) {
+    const coord_t g = slot_to_cell(args.mesh, color, (*pir)[1]);
+    if (g < 0 || g >= num_cells) {
+      acc_xmin[*pir] = acc_xmax[*pir] = (g < 0) ? 0.0 : 1.0;
+      continue;
+    } // if
+    acc_xmin[*pir] = moving_node(g, num_cells, args.amplitude, args.phase);
+    acc_xmax[*pir] =
+        moving_node(g + 1, num_cells, args.amplitude, args.phase);
+  } // for
+
+} // move_mesh_task
 
-} // init large
+//------------------------------------------------------------------------
+// Extent of the owned cells of one color along the first axis; cells are
+// ordered along it row by row
+template <int DIM>
+piece_extent_t bounds_task(const Task *task,
+                           const std::vector<PhysicalRegion> &regions,
+                           Context ctx, Runtime *runtime) {
+
+  assert(regions.size() == 1);
+  assert(task->regions.size() == 1);
+  assert(task->regions[0].privilege_fields.size() == 2);
+  assert(task->arglen == sizeof(mesh_args_t));
+
+  const mesh_args_t &mesh = *static_cast<const mesh_args_t *>(task->args);
+
+  const FieldAccessor<READ_ONLY, double, DIM + 1> acc_xmin(regions[0],
+                                                           XMIN_FID);
+  const FieldAccessor<READ_ONLY, double, DIM + 1> acc_xmax(regions[0],
+                                                           XMAX_FID);
+  const std::vector<Rect<DIM + 1>> rows = owned_rows<DIM>(
+      ctx, runtime, task->regions[0].region, mesh.num_elmts);
+  assert(!rows.empty());
+
+  const size_t color = task->index_point.point_data[0];
+  return {acc_xmin[rows.front().lo], acc_xmax[rows.back().hi], color};
+} // bounds_task
 
 //------------------------------------------------------------------------
-void fill_part_task(const Task *task,
-                    const std::vector<PhysicalRegion> &regions, Context ctx,
-                    Runtime *runtime) {
+// Largest drift of the bounds of an owned cell of one color from the ones
+// last recorded, see record_bounds
+template <int DIM>
+double motion_task(const Task *task, const std::vector<PhysicalRegion> &regions,
+                   Context ctx, Runtime *runtime) {
+
   assert(regions.size() == 1);
   assert(task->regions.size() == 1);
   assert(task->regions[0].privilege_fields.size() == 4);
+  assert(task->arglen == sizeof(mesh_args_t));
+
+  typedef field_view_t<READ_ONLY, DIM + 1> ro_view_t;
+
+  const mesh_args_t &mesh = *static_cast<const mesh_args_t *>(task->args);
+  const FieldID fids[4] = {XMIN_FID, XMAX_FID, XMIN_REF_FID, XMAX_REF_FID};
+
+  // bounds only depend on the first axis, so one line per row is enough
+  double drift = 0;
+  for (const Rect<DIM + 1> &row : owned_rows<DIM>(
+           ctx, runtime, task->regions[0].region, mesh.num_elmts)) {
+    const Rect<DIM + 1> line = axis_line(row);
+    std::vector<double> copies[4];
+    const double *values[4];
+    for (int k = 0; k < 4; k++)
+      values[k] =
+          row_values(ro_view_t(regions[0], fids[k], line), line, copies[k]);
+    for (size_t i = 0; i < line.volume(); i++)
+      drift = std::max(drift, std::max(std::abs(values[0][i] - values[2][i]),
+                                       std::abs(values[1][i] - values[3][i])));
+  } // for
+  return drift;
+} // motion_task
 
-  std::cout << "Inside of the Fill_part_task" << std::endl;
-  auto color = task->index_point.point_data[0];
+//------------------------------------------------------------------------
+// Builds the BVH over the owned cells of one source color and writes its
+// flat nodes and box order into the row of the color, see bvh_t. Boxes
+// are identified by their slot along the first axis.
+template <int DIM>
+void build_bvh_task(const Task *task,
+                    const std::vector<PhysicalRegion> &regions, Context ctx,
+                    Runtime *runtime) {
+  assert(regions.size() == 2);
+  assert(task->regions.size() == 2);
+  assert(task->regions[0].privilege_fields.size() == 2);
+  assert(task->regions[1].privilege_fields.size() == 2);
+  assert(task->arglen == sizeof(mesh_args_t));
+
+  typedef field_view_t<READ_ONLY, DIM + 1> ro_view_t;
+
+  const mesh_args_t &mesh = *static_cast<const mesh_args_t *>(task->args);
+  const coord_t color = task->index_point.point_data[0];
+  const Rect<DIM + 1> row =
+      axis_line(slab<DIM>(color, color, 0, mesh.num_elmts - 1,
+                          mesh.num_cross));
+  std::vector<double> xmin_copy, xmax_copy;
+  const double *xmin =
+      row_values(ro_view_t(regions[1], XMIN_FID, row), row, xmin_copy);
+  const double *xmax =
+      row_values(ro_view_t(regions[1], XMAX_FID, row), row, xmax_copy);
+
+  std::vector<box_t<1>> boxes(mesh.num_elmts);
+  for (size_t i = 0; i < boxes.size(); i++)
+    boxes[i] = {{xmin[i]}, {xmax[i]}};
+  const bvh_t<1> bvh(std::move(boxes));
+
+  const FieldAccessor<WRITE_DISCARD, bvh_node_t<1>, 2> acc_node(
+      regions[0], BVH_NODE_FID);
+  const FieldAccessor<WRITE_DISCARD, size_t, 2> acc_order(regions[0],
+                                                          BVH_ORDER_FID);
+  for (size_t k = 0; k < bvh.nodes().size(); k++)
+    acc_node[Legion::Point<2>(color, k)] = bvh.nodes()[k];
+  for (size_t i = 0; i < bvh.order().size(); i++)
+    acc_order[Legion::Point<2>(color, i)] = bvh.order()[i];
+} // build_bvh_task
 
-  const FieldAccessor<WRITE_DISCARD, Rect<2>, 2> acc1(regions[0], PART_FID1);
-  const FieldAccessor<WRITE_DISCARD, Rect<2>, 2> acc2(regions[0], PART_FID2);
-  const FieldAccessor<WRITE_DISCARD, Rect<2>, 2> acc3(regions[0], PART_FID3);
-  const FieldAccessor<WRITE_DISCARD, Rect<2>, 2> acc4(regions[0], PART_FID4);
+//------------------------------------------------------------------------
+// Computes the source pieces overlapped by one color of the large mesh from
+// the cell bounds of both meshes: an interval search over the extents of
+// the source colors selects the candidate pieces, and a binary search over
+// the cells of each candidate gives the tight range of overlapped cells
+// along the first axis, across all cells of the others. The extent of the
+// target color is padded by part_args_t::padding. regions[0] holds the
+// target color, regions[1] the whole small mesh, both restricted to their
+// first-axis lines (see mesh_t::axis_lr).
+// With part_args_t::bvh the cells are not assumed to be sorted, as those
+// of unstructured meshes: regions[2] holds the BVHs over the owned cells
+// of every source color (see build_bvh_task), and every one whose root
+// intersects the padded bounding box of the target color is queried with
+// every padded owned target cell. The overlapped source cells of every
+// color are returned as one run of slots, from the first to the last of
+// them; the cells of the run that overlap no target cell get no weight
+// in the remap.
+template <int DIM>
+static void find_overlaps(const Task *task,
+                          const std::vector<PhysicalRegion> &regions,
+                          Context ctx, Runtime *runtime,
+                          std::vector<Rect<DIM + 1>> &overlaps) {
+  typedef field_view_t<READ_ONLY, DIM + 1> ro_view_t;
+
+  assert(task->arglen == sizeof(part_args_t));
+  const part_args_t &part_args =
+      *static_cast<const part_args_t *>(task->args);
+  const remap_args_t &args = part_args.meshes;
+
+  const std::vector<Rect<DIM + 1>> rows_l = owned_rows<DIM>(
+      ctx, runtime, regions[0].get_logical_region(), args.large.num_elmts);
+  assert(!rows_l.empty());
+
+  // cell bounds of every source color
+  const Rect<DIM + 1> rect_s = runtime->get_index_space_domain(
+      ctx, regions[1].get_logical_region().get_index_space());
+  const ro_view_t acc_s_xmin(regions[1], XMIN_FID, rect_s);
+  const ro_view_t acc_s_xmax(regions[1], XMAX_FID, rect_s);
+  const coord_t n_src = args.small.num_elmts;
+
+  if (part_args.bvh) {
+    // padded owned target cells and their bounding box
+    std::vector<box_t<1>> cells;
+    for (const Rect<DIM + 1> &rect_l : rows_l) {
+      std::vector<double> xmin_copy, xmax_copy;
+      const Rect<DIM + 1> line = axis_line(rect_l);
+      const double *xmin = row_values(
+          ro_view_t(regions[0], XMIN_FID, line), line, xmin_copy);
+      const double *xmax = row_values(
+          ro_view_t(regions[0], XMAX_FID, line), line, xmax_copy);
+      for (size_t t = 0; t < line.volume(); t++)
+        cells.push_back(
+            {{xmin[t] - part_args.padding}, {xmax[t] + part_args.padding}});
+    } // for
+    box_t<1> bbox = cells.front();
+    for (const box_t<1> &cell : cells)
+      bbox.extend(cell);
+
+    const size_t max_nodes = bvh_t<1>::max_nodes(n_src);
+    std::vector<size_t> hits;
+    for (size_t s = 0; s < args.small.num_colors; s++) {
+      std::vector<bvh_node_t<1>> node_copy;
+      const bvh_node_t<1> *nodes = row_data(
+          regions[2], BVH_NODE_FID,
+          Rect<2>(Legion::Point<2>(s, 0), Legion::Point<2>(s, max_nodes - 1)),
+          node_copy);
+      if (!nodes[0].bounds.intersects(bbox))
+        continue;
+
+      std::vector<size_t> order_copy;
+      const size_t *order = row_data(
+          regions[2], BVH_ORDER_FID,
+          Rect<2>(Legion::Point<2>(s, 0), Legion::Point<2>(s, n_src - 1)),
+          order_copy);
+      const Rect<DIM + 1> row = axis_line(
+          slab<DIM>(s, s, 0, n_src - 1, args.small.num_cross));
+      std::vector<double> xmin_copy, xmax_copy;
+      const double *xmin = row_values(acc_s_xmin, row, xmin_copy);
+      const double *xmax = row_values(acc_s_xmax, row, xmax_copy);
+      auto boxes = [&](size_t i) { return box_t<1>{{xmin[i]}, {xmax[i]}}; };
+
+      hits.clear();
+      for (const box_t<1> &cell : cells)
+        bvh_query(nodes, order, boxes, cell, hits);
+      if (hits.empty())
+        continue;
+      const auto range = std::minmax_element(hits.begin(), hits.end());
+      overlaps.push_back(slab<DIM>(s, s, *range.first, *range.second,
+                                   args.small.num_cross));
+    } // for
+    return;
+  } // if
+
+  // padded extent of the owned cells of this color, which may span several
+  // rows (see create_targets)
+  const FieldAccessor<READ_ONLY, double, DIM + 1> acc_l_xmin(regions[0],
+                                                             XMIN_FID);
+  const FieldAccessor<READ_ONLY, double, DIM + 1> acc_l_xmax(regions[0],
+                                                             XMAX_FID);
+  const double lo = acc_l_xmin[rows_l.front().lo] - part_args.padding;
+  const double hi = acc_l_xmax[rows_l.back().hi] + part_args.padding;
+
+  std::vector<piece_extent_t> extents;
+  extents.reserve(args.small.num_colors);
+  for (size_t s = 0; s < args.small.num_colors; s++) {
+    const Rect<DIM + 1> row = axis_line(
+        slab<DIM>(s, s, 0, n_src - 1, args.small.num_cross));
+    extents.push_back({acc_s_xmin[row.lo], acc_s_xmax[row.hi], s});
+  } // for
+  const piece_search_t search(std::move(extents));
+
+  std::vector<size_t> colors;
+  search.query(lo, hi, colors);
+
+  for (size_t s : colors) {
+    const Rect<DIM + 1> row = axis_line(
+        slab<DIM>(s, s, 0, n_src - 1, args.small.num_cross));
+    std::vector<double> xmin_copy, xmax_copy;
+    const double *xmin = row_values(acc_s_xmin, row, xmin_copy);
+    const double *xmax = row_values(acc_s_xmax, row, xmax_copy);
+
+    size_t first, last;
+    if (cell_range(xmin, xmax, n_src, lo, hi, first, last))
+      overlaps.push_back(
+          slab<DIM>(s, s, first, last, args.small.num_cross));
+  } // for
+} // find_overlaps
 
-  auto rect = runtime->get_index_space_domain(
+//------------------------------------------------------------------------
+// Writes the list of overlapped source rects of one color into its row of
+// RECT_FID; the rest of the row is padded with empty rects. With
+// part_args_t::bvh, regions[3] holds the BVHs of the source colors.
+template <int DIM>
+void fill_part_task(const Task *task,
+                    const std::vector<PhysicalRegion> &regions, Context ctx,
+                    Runtime *runtime) {
+  assert(regions.size() == task->regions.size());
+  assert(regions.size() == 3 || regions.size() == 4);
+  for (size_t r = 0; r < regions.size(); r++)
+    assert(task->regions[r].privilege_fields.size() == (r == 0 ? 1 : 2));
+
+  std::vector<Rect<DIM + 1>> overlaps;
+  const std::vector<PhysicalRegion> mesh_regions(regions.begin() + 1,
+                                                 regions.end());
+  find_overlaps<DIM>(task, mesh_regions, ctx, runtime, overlaps);
+
+  const FieldAccessor<WRITE_DISCARD, Rect<DIM + 1>, 2> acc(regions[0],
+                                                           RECT_FID);
+  Rect<2> rect = runtime->get_index_space_domain(
       ctx, task->regions[0].region.get_index_space());
+  assert(overlaps.size() <= rect.volume());
 
-  PointInRectIterator<2> pir(rect);
-
-  switch (color) {
-  case 0: {
-    acc1[*pir] = {{0, 0}, {0, 65}};
-    break;
-  }
-  case 1: {
-    acc1[*pir] = {{0, 0}, {0, 65}};
-    acc2[*pir] = {{1, 0}, {1, 65}};
-    break;
-  }
-  case 2: {
-    acc2[*pir] = {{1, 0}, {1, 65}};
-    break;
-  }
-  case 3: {
-    acc1[*pir] = {{0, 0}, {0, 65}};
-    acc3[*pir] = {{2, 0}, {2, 45}};
-    break;
-  }
-  case 4: {
-    acc1[*pir] = {{0, 0}, {0, 65}};
-    acc2[*pir] = {{1, 0}, {1, 65}};
-    acc3[*pir] = {{2, 0}, {2, 45}};
-    acc4[*pir] = {{3, 0}, {3, 15}};
-    break;
-  }
-  case 5: {
-    acc2[*pir] = {{1, 0}, {1, 65}};
-    acc4[*pir] = {{3, 0}, {3, 15}};
-    break;
-  }
-  case 6: {
-    acc3[*pir] = {{2, 0}, {2, 45}};
-    break;
-  }
-  case 7: {
-    acc3[*pir] = {{2, 0}, {2, 45}};
-    acc4[*pir] = {{3, 0}, {3, 15}};
-    break;
-  }
-  case 8: {
-    acc4[*pir] = {{3, 0}, {3, 15}};
-    break;
-  }
-  }
+  for (PointInRectIterator<2> pir(rect); pir(); pir++) {
+    const size_t k = (*pir)[1] - rect.lo[1];
+    acc[*pir] =
+        (k < overlaps.size()) ? overlaps[k] : Rect<DIM + 1>::make_empty();
+  } // for
 
 } // fill_part_task
 
 //------------------------------------------------------------------------
+// First-order conservative remap of the small mesh onto one color of the
+// large mesh: every owned target cell receives the volume-weighted average
+// of the source cells it intersects, for every field of the target
+// requirement. The weights are the tensor product of the weights along the
+// first axis, computed once from the cell bounds, and of the fixed weights
+// between the uniform cells of the other axes; they are shared by all
+// fields. Values are accessed in place through raw pointers and their
+// strides, so SOA and AOS instances are handled alike; cell bounds of
+// strided layouts, and values of instances that are not affine over a
+// row, are gathered into copies (see field_view_t). The source pieces are
+// listed by the rect list the overlap is the image of, so the compact
+// source instance, sized to their union, is addressed piece by piece
+// without walking its layout. The target cells are remapped row by row,
+// in independent chunks along the first axis, which the OpenMP variant
+// spreads over its threads.
+template <int DIM>
 void remap_task(const Task *task, const std::vector<PhysicalRegion> &regions,
                 Context ctx, Runtime *runtime) {
 
+  typedef field_view_t<READ_WRITE, DIM + 1> rw_view_t;
+  typedef field_view_t<READ_ONLY, DIM + 1> ro_view_t;
+
+  const std::set<FieldID> &fids = task->regions[0].privilege_fields;
+  const size_t num_fields = fids.size();
+
+  // the target is one region or a group of regions compacted into one
+  // instance, e.g. the exclusive, shared and ghost parts of a row; only
+  // the writable ones are remapped. The cell bounds of the source and the
+  // target follow the source values, see launch_remap.
+  const size_t num_targets = mapper::compacted_count(task->regions, 0);
+  const size_t src = num_targets, src_bounds = num_targets + 1,
+               tgt_bounds = num_targets + 2, pieces = num_targets + 3;
+  std::vector<size_t> written;
+  for (size_t k = 0; k < num_targets; k++)
+    if (task->regions[k].privilege != READ_ONLY)
+      written.push_back(k);
+
+  assert(regions.size() == num_targets + 4);
+  assert(task->regions.size() == num_targets + 4);
+  assert(num_fields > 0);
+  assert(task->regions[src].privilege_fields.size() == num_fields);
+  assert(task->regions[src_bounds].privilege_fields.size() == 2);
+  assert(task->regions[tgt_bounds].privilege_fields.size() == 2);
+  assert(task->regions[pieces].privilege_fields.size() == 1);
+  assert(task->arglen == sizeof(remap_args_t));
+
+  const remap_args_t &args = *static_cast<const remap_args_t *>(task->args);
+
+  // copies of the values and cell bounds that cannot be accessed in place;
+  // a deque keeps the pointers into earlier copies valid as more are added
+  std::deque<std::vector<double>> copies;
+  auto bounds = [&](size_t r, FieldID fid, const Rect<DIM + 1> &rect) {
+    copies.emplace_back();
+    const Rect<DIM + 1> line = axis_line(rect);
+    return row_values(ro_view_t(regions[r], fid, line), line, copies.back());
+  };
+
+  // table of the owned cells of every overlapped source piece: base
+  // pointers and strides of every field, and cell bounds; ghost slots
+  // duplicate cells owned by the neighbouring colors
+  struct source_run_t {
+    std::vector<const double *> val;
+    std::vector<size_t> stride;
+    const double *xmin, *xmax;
+    size_t n;
+  };
+  std::vector<source_run_t> runs;
+  const FieldAccessor<READ_ONLY, Rect<DIM + 1>, 2> acc_pieces(regions[pieces],
+                                                              RECT_FID);
+  const Rect<2> table = runtime->get_index_space_domain(
+      ctx, task->regions[pieces].region.get_index_space());
+  // views of the source fields and bounds, moved from piece to piece
+  std::vector<ro_view_t> acc_s;
+  acc_s.reserve(num_fields);
+  for (FieldID fid : fids)
+    acc_s.emplace_back(regions[src], fid);
+  ro_view_t acc_s_xmin(regions[src_bounds], XMIN_FID);
+  ro_view_t acc_s_xmax(regions[src_bounds], XMAX_FID);
+  for (PointInRectIterator<2> pir(table); pir(); pir++) {
+    // the pieces come first, followed by the empty rects padding the
+    // table (see fill_part_task)
+    Rect<DIM + 1> rows = acc_pieces[*pir];
+    if (rows.empty())
+      break;
+    rows.hi[1] =
+        std::min<coord_t>(rows.hi[1], coord_t(args.small.num_elmts) - 1);
+    // overlaps span all cells of the other axes (see find_overlaps)
+    for (int d = 2; d <= DIM; d++)
+      assert(rows.lo[d] == 0 &&
+             rows.hi[d] == coord_t(args.small.num_cross) - 1);
+
+    // every rect of the table lies in one row (see find_overlaps)
+    assert(rows.lo[0] == rows.hi[0]);
+
+    // views bounded by the piece, which is one piece of the compact
+    // instance of the source
+    source_run_t run;
+    run.n = rows.hi[1] - rows.lo[1] + 1;
+    run.stride.resize(num_fields * DIM);
+    for (size_t f = 0; f < num_fields; f++) {
+      acc_s[f].rebound(rows);
+      copies.emplace_back();
+      run.val.push_back(mesh_ptr<DIM>(acc_s[f], rows, &run.stride[f * DIM],
+                                      copies.back()));
+    } // for
+    const Rect<DIM + 1> line = axis_line(rows);
+    acc_s_xmin.rebound(line);
+    acc_s_xmax.rebound(line);
+    copies.emplace_back();
+    run.xmin = row_values(acc_s_xmin, line, copies.back());
+    copies.emplace_back();
+    run.xmax = row_values(acc_s_xmax, line, copies.back());
+    runs.push_back(run);
+  } // for
+
+  // weights between the cells of the other axes, the same for every axis
+  remap_weights_t cross;
+  if (DIM > 1)
+    uniform_remap_weights(args.small.num_cross, args.large.num_cross, cross);
+
+  // only the owned cells of the target are remapped, one run of a row at a
+  // time, and ghosts are left as is; balanced targets may span several
+  // rows, shared cells make two runs of a row
+  std::vector<std::pair<size_t, Rect<DIM + 1>>> targets;
+  for (size_t k = 0; k < written.size(); k++)
+    for (const Rect<DIM + 1> &rect :
+         owned_rows<DIM>(ctx, runtime, task->regions[written[k]].region,
+                         args.large.num_elmts))
+      targets.emplace_back(k, rect);
+  for (const auto &target : targets) {
+    // views bounded by the run, which may be a piece of a compact instance
+    const Rect<DIM + 1> &rect_l = target.second;
+    const size_t n_tgt = rect_l.hi[1] - rect_l.lo[1] + 1;
+    const double *tgt_xmin = bounds(tgt_bounds, XMIN_FID, rect_l);
+    const double *tgt_xmax = bounds(tgt_bounds, XMAX_FID, rect_l);
+    std::vector<rw_view_t> acc_l;
+    acc_l.reserve(num_fields);
+    std::vector<std::vector<double>> tgt_copy(num_fields);
+    std::vector<double *> tgt_val(num_fields);
+    std::vector<size_t> tgt_stride(num_fields * DIM);
+    for (FieldID fid : fids) {
+      const size_t f = acc_l.size();
+      acc_l.emplace_back(regions[written[target.first]], fid, rect_l);
+      tgt_val[f] = mesh_ptr<DIM>(acc_l[f], rect_l, &tgt_stride[f * DIM],
+                                 tgt_copy[f]);
+    } // for
+
+    const size_t chunk_cells = on_omp_proc(task) ? 4096 : n_tgt;
+    const size_t num_chunks = (n_tgt + chunk_cells - 1) / chunk_cells;
+#ifdef _OPENMP
+#pragma omp parallel for if (num_chunks > 1)
+#endif
+    for (size_t c = 0; c < num_chunks; c++) {
+      const size_t lo = c * chunk_cells;
+      const size_t n = std::min(chunk_cells, n_tgt - lo);
+      size_t count[DIM];
+      count[0] = n;
+      for (int d = 1; d < DIM; d++)
+        count[d] = args.large.num_cross;
+      for (size_t f = 0; f < num_fields; f++)
+        fill_block(tgt_val[f] + lo * tgt_stride[f * DIM], count,
+                   &tgt_stride[f * DIM], DIM, 0.0);
+
+      remap_weights_t weights;
+      const remap_weights_t *axes[DIM];
+      axes[0] = &weights;
+      for (int d = 1; d < DIM; d++)
+        axes[d] = &cross;
+      for (const source_run_t &run : runs) {
+        size_t first, last;
+        if (!cell_range(run.xmin, run.xmax, run.n, tgt_xmin[lo],
+                        tgt_xmax[lo + n - 1], first, last))
+          continue;
+        weights.clear();
+        compute_remap_weights(run.xmin + first, run.xmax + first,
+                              last - first + 1, tgt_xmin + lo, tgt_xmax + lo,
+                              n, weights);
+        // stream every field through the same weights
+        for (size_t f = 0; f < num_fields; f++) {
+          const size_t *src_stride = &run.stride[f * DIM];
+          const size_t *dst_stride = &tgt_stride[f * DIM];
+          apply_tensor_weights(axes, DIM, run.val[f] + first * src_stride[0],
+                               src_stride, tgt_val[f] + lo * dst_stride[0],
+                               dst_stride);
+        } // for
+      }   // for
+    }     // for
+
+    for (size_t f = 0; f < num_fields; f++)
+      acc_l[f].store(rect_l, tgt_copy[f]);
+  } // for
+
+} // remap task
+
+//------------------------------------------------------------------------
+// Push-style counterpart of remap_task for one color of the small mesh:
+// the weighted contributions of its owned cells are folded into the large
+// mesh cells they intersect with the sum reduction, for every field of the
+// reduction requirement and with weights shared by all fields. The target
+// values have been zeroed by the launch.
+template <int DIM>
+void push_remap_task(const Task *task,
+                     const std::vector<PhysicalRegion> &regions, Context ctx,
+                     Runtime *runtime) {
+
+  typedef field_view_t<READ_ONLY, DIM + 1> ro_view_t;
+  // reduction instances are created for the single rect of the target
+  // region (see launch_push_remap), so they are always affine over it
+  typedef ReductionAccessor<SumReduction<double>, false, DIM + 1, coord_t,
+                            Realm::AffineAccessor<double, DIM + 1, coord_t>>
+      sum_accessor_t;
+
+  const std::set<FieldID> &fids = task->regions[1].privilege_fields;
+  const size_t num_fields = fids.size();
+
+  assert(regions.size() == 4);
+  assert(task->regions.size() == 4);
+  assert(num_fields > 0);
+  assert(task->regions[0].privilege_fields.size() == num_fields);
+  assert(task->regions[2].privilege_fields.size() == 2);
+  assert(task->regions[3].privilege_fields.size() == 2);
+  assert(task->arglen == sizeof(remap_args_t));
+
+  const remap_args_t &args = *static_cast<const remap_args_t *>(task->args);
+
+  // only the owned cells of the source are pushed
+  Rect<DIM + 1> rect_s = runtime->get_index_space_domain(
+      ctx, task->regions[0].region.get_index_space());
+  rect_s.hi[1] = std::min<coord_t>(rect_s.hi[1],
+                                   rect_s.lo[1] + args.small.num_elmts - 1);
+  const Rect<DIM + 1> rect_l = runtime->get_index_space_domain(
+      ctx, task->regions[1].region.get_index_space());
+  if (rect_s.empty() || rect_l.empty())
+    return;
+
+  std::vector<sum_accessor_t> acc_l;
+  for (FieldID fid : fids)
+    acc_l.emplace_back(regions[1], fid, LEGION_REDOP_SUM_FLOAT64, rect_l);
+
+  std::deque<std::vector<double>> copies;
+  auto values = [&](size_t r, FieldID fid, const Rect<DIM + 1> &rect) {
+    copies.emplace_back();
+    const Rect<DIM + 1> line = axis_line(rect);
+    return row_values(ro_view_t(regions[r], fid, line), line, copies.back());
+  };
+
+  const size_t n_src = rect_s.hi[1] - rect_s.lo[1] + 1;
+  std::vector<const double *> src_val;
+  std::vector<size_t> src_stride(num_fields * DIM);
+  for (FieldID fid : fids) {
+    const size_t f = src_val.size();
+    copies.emplace_back();
+    src_val.push_back(mesh_ptr<DIM>(ro_view_t(regions[0], fid, rect_s),
+                                    rect_s, &src_stride[f * DIM],
+                                    copies.back()));
+  } // for
+  const double *src_xmin = values(3, XMIN_FID, rect_s);
+  const double *src_xmax = values(3, XMAX_FID, rect_s);
+
+  // weights between the cells of the other axes, the same for every axis
+  remap_weights_t weights, cross;
+  if (DIM > 1)
+    uniform_remap_weights(args.small.num_cross, args.large.num_cross, cross);
+  const remap_weights_t *axes[DIM];
+  axes[0] = &weights;
+  for (int d = 1; d < DIM; d++)
+    axes[d] = &cross;
+
+  std::vector<double> contrib;
+  for (coord_t row = rect_l.lo[0]; row <= rect_l.hi[0]; row++) {
+    Rect<DIM + 1> row_rect = rect_l;
+    row_rect.lo[0] = row_rect.hi[0] = row;
+    const size_t n_tgt = row_rect.hi[1] - row_rect.lo[1] + 1;
+    const double *tgt_xmin = values(2, XMIN_FID, row_rect);
+    const double *tgt_xmax = values(2, XMAX_FID, row_rect);
+
+    size_t first, last;
+    if (!cell_range(tgt_xmin, tgt_xmax, n_tgt, src_xmin[0],
+                    src_xmax[n_src - 1], first, last))
+      continue;
+
+    // accumulate locally into a dense block, then fold every target cell
+    // once per field
+    Rect<DIM + 1> block = row_rect;
+    block.lo[1] = row_rect.lo[1] + first;
+    block.hi[1] = row_rect.lo[1] + last;
+    size_t count[DIM], stride[DIM];
+    for (int d = 0; d < DIM; d++)
+      count[d] = block.hi[d + 1] - block.lo[d + 1] + 1;
+    stride[DIM - 1] = 1;
+    for (int d = DIM - 1; d > 0; d--)
+      stride[d - 1] = stride[d] * count[d];
+
+    weights.clear();
+    compute_remap_weights(src_xmin, src_xmax, n_src, tgt_xmin + first,
+                          tgt_xmax + first, last - first + 1, weights);
+    for (size_t f = 0; f < num_fields; f++) {
+      contrib.assign(stride[0] * count[0], 0.0);
+      apply_tensor_weights(axes, DIM, src_val[f], &src_stride[f * DIM],
+                           contrib.data(), stride);
+      for (PointInRectIterator<DIM + 1> pir(block); pir(); pir++) {
+        size_t k = 0;
+        for (int d = 0; d < DIM; d++)
+          k += ((*pir)[d + 1] - block.lo[d + 1]) * stride[d];
+        acc_l[f][*pir] <<= contrib[k];
+      } // for
+    }   // for
+  }     // for
+
+} // push_remap_task
+
+//------------------------------------------------------------------------
+// Copies into the ghost slots of one color the values of the cells they
+// mirror, read from the shared cells of the neighbouring colors. Ghosts
+// past the domain boundary hold zero.
+template <int DIM>
+void ghost_task(const Task *task, const std::vector<PhysicalRegion> &regions,
+                Context ctx, Runtime *runtime) {
+
   assert(regions.size() == 2);
   assert(task->regions.size() == 2);
-  assert(task->regions[0].privilege_fields.size() == 1);
-  assert(task->regions[1].privilege_fields.size() == 1);
+  assert(task->arglen == sizeof(mesh_args_t));
 
-  const FieldAccessor<READ_WRITE, size_t, 2> acc_l(regions[0], FID);
+  const mesh_args_t &mesh = *static_cast<const mesh_args_t *>(task->args);
+  assert(task->regions[0].privilege_fields.size() == mesh.num_fields);
+  const coord_t num_elmts = mesh.num_elmts;
+  const coord_t num_cells = num_elmts * mesh.num_colors;
 
-  auto rect_l = runtime->get_index_space_domain(
+  auto color = task->index_point.point_data[0];
+  const Rect<DIM + 1> rect = runtime->get_index_space_domain(
       ctx, task->regions[0].region.get_index_space());
+  for (FieldID fid : task->regions[0].privilege_fields) {
+    const FieldAccessor<WRITE_DISCARD, double, DIM + 1> acc(regions[0], fid);
+    const FieldAccessor<READ_ONLY, double, DIM + 1> acc_n(regions[1], fid);
+    for (PointInRectIterator<DIM + 1> pir(rect); pir(); pir++) {
+      const coord_t g = slot_to_cell(mesh, color, (*pir)[1]);
+      if (g < 0 || g >= num_cells) {
+        acc[*pir] = 0;
+        continue;
+      } // if
+      Legion::Point<DIM + 1> p = *pir;
+      p[0] = g / num_elmts;
+      p[1] = g % num_elmts;
+      acc[*pir] = acc_n[p];
+    } // for
+  }   // for
+
+} // ghost_task
 
-  const FieldAccessor<READ_ONLY, size_t, 2> acc_s(regions[1], FID);
+//------------------------------------------------------------------------
+// Stand-in for the physics update of the source mesh between two remaps:
+// one explicit smoothing step of every field along the first axis over the
+// owned cells of a color
+template <int DIM>
+void update_task(const Task *task, const std::vector<PhysicalRegion> &regions,
+                 Context ctx, Runtime *runtime) {
 
-  auto rect_s = runtime->get_index_space_domain(
-      ctx, task->regions[1].region.get_index_space());
+  typedef field_view_t<READ_WRITE, DIM + 1> rw_view_t;
 
-   auto color = task->index_point.point_data[0];
+  assert(regions.size() == 1);
+  assert(task->regions.size() == 1);
+  assert(task->arglen == sizeof(mesh_args_t));
 
-  for (PieceIterator pir(regions[1], FID, true); pir(); pir++) {
-    std::cout << "IRINA DEBUG color = " <<color<< "overlap rect = " << *pir << std::endl;
-    for (PointInRectIterator<2> pir2(*pir); pir2(); pir2++) {
-  //    std::cout << acc_s[*pir2] << std::endl;
-    }
-  }
+  const mesh_args_t &mesh = *static_cast<const mesh_args_t *>(task->args);
+  assert(task->regions[0].privilege_fields.size() == mesh.num_fields);
 
-} // remap task
+  Rect<DIM + 1> rect = runtime->get_index_space_domain(
+      ctx, task->regions[0].region.get_index_space());
+  rect.hi[1] =
+      std::min<coord_t>(rect.hi[1], rect.lo[1] + mesh.num_elmts - 1);
+  const coord_t n = rect.hi[1] - rect.lo[1] + 1;
+  if (rect.empty() || n < 3)
+    return;
+
+  Rect<DIM + 1> starts = rect;
+  starts.hi[1] = rect.lo[1];
+  for (FieldID fid : task->regions[0].privilege_fields) {
+    const rw_view_t acc(regions[0], fid, rect);
+    for (PointInRectIterator<DIM + 1> sir(starts); sir(); sir++) {
+      Rect<DIM + 1> line(*sir, *sir);
+      line.hi[1] = rect.hi[1];
+      size_t strides[DIM + 1];
+      std::vector<double> copy;
+      double *val = acc.block(line, strides, copy);
+      const size_t s = strides[1];
+
+      double prev = val[0];
+      for (coord_t i = 1; i + 1 < n; i++) {
+        const double cur = val[i * s];
+        val[i * s] = cur + 0.25 * (prev - 2 * cur + val[(i + 1) * s]);
+        prev = cur;
+      } // for
+      acc.store(line, copy);
+    } // for
+  }   // for
+
+} // update_task
 
 //------------------------------------------------------------------------
-int main(int argc, char **argv) {
-
-  Runtime::set_top_level_task_id(TOP_LEVEL_TASK_ID);
+// Registers the tasks of DIM-dimensional meshes under their dim_task IDs
+template <int DIM> static void register_mesh_tasks() {
   {
-    TaskVariantRegistrar registrar(TOP_LEVEL_TASK_ID, "top_level");
+    TaskVariantRegistrar registrar(dim_task<DIM>(INIT_SMALL_TASK_ID),
+                                   "init small");
     registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
-    registrar.set_inner();
-    registrar.set_replicable();
-    Runtime::preregister_task_variant<top_level_task>(registrar, "top_level");
+    Runtime::preregister_task_variant<init_small_task<DIM>>(registrar,
+                                                            "init small");
+  }
+  {
+    TaskVariantRegistrar registrar(dim_task<DIM>(INIT_LARGE_TASK_ID),
+                                   "init large");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    Runtime::preregister_task_variant<init_large_task<DIM>>(registrar,
+                                                            "init large");
+  }
+  {
+    TaskVariantRegistrar registrar(dim_task<DIM>(FILL_PART_TASK_ID),
+                                   "fill partition");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    Runtime::preregister_task_variant<fill_part_task<DIM>>(registrar,
+                                                           "fill_partition");
+  }
+  {
+    TaskVariantRegistrar registrar(dim_task<DIM>(BUILD_BVH_TASK_ID),
+                                   "build bvh");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    Runtime::preregister_task_variant<build_bvh_task<DIM>>(registrar,
+                                                           "build bvh");
+  }
+  {
+    TaskVariantRegistrar registrar(dim_task<DIM>(REMAP_TASK_ID), "remap");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    Runtime::preregister_task_variant<remap_task<DIM>>(registrar, "remap");
+  }
+#ifdef REALM_USE_OPENMP
+  // the same tasks on OpenMP processors, chosen by the mapper for launches
+  // tagged prefer_omp
+  {
+    TaskVariantRegistrar registrar(dim_task<DIM>(INIT_SMALL_TASK_ID),
+                                   "init small omp");
+    registrar.add_constraint(ProcessorConstraint(Processor::OMP_PROC));
+    Runtime::preregister_task_variant<init_small_task<DIM>>(registrar,
+                                                            "init small");
+  }
+  {
+    TaskVariantRegistrar registrar(dim_task<DIM>(INIT_LARGE_TASK_ID),
+                                   "init large omp");
+    registrar.add_constraint(ProcessorConstraint(Processor::OMP_PROC));
+    Runtime::preregister_task_variant<init_large_task<DIM>>(registrar,
+                                                            "init large");
+  }
+  {
+    TaskVariantRegistrar registrar(dim_task<DIM>(REMAP_TASK_ID), "remap omp");
+    registrar.add_constraint(ProcessorConstraint(Processor::OMP_PROC));
+    Runtime::preregister_task_variant<remap_task<DIM>>(registrar, "remap");
+  }
+#endif
+  {
+    TaskVariantRegistrar registrar(dim_task<DIM>(PUSH_REMAP_TASK_ID),
+                                   "push remap");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    Runtime::preregister_task_variant<push_remap_task<DIM>>(registrar,
+                                                            "push remap");
+  }
+  {
+    TaskVariantRegistrar registrar(dim_task<DIM>(GHOST_TASK_ID), "ghost");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    Runtime::preregister_task_variant<ghost_task<DIM>>(registrar, "ghost");
   }
   {
-    TaskVariantRegistrar registrar(INIT_SMALL_TASK_ID, "init small");
+    TaskVariantRegistrar registrar(dim_task<DIM>(BOUNDS_TASK_ID), "bounds");
     registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
-    Runtime::preregister_task_variant<init_small_task>(registrar, "init small");
+    Runtime::preregister_task_variant<piece_extent_t, bounds_task<DIM>>(
+        registrar, "bounds");
   }
   {
-    TaskVariantRegistrar registrar(INIT_LARGE_TASK_ID, "init large");
+    TaskVariantRegistrar registrar(dim_task<DIM>(MOTION_TASK_ID), "motion");
     registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
-    Runtime::preregister_task_variant<init_large_task>(registrar, "init large");
+    Runtime::preregister_task_variant<double, motion_task<DIM>>(registrar,
+                                                                "motion");
   }
   {
-    TaskVariantRegistrar registrar(FILL_PART_TASK_ID, "fill partition");
+    TaskVariantRegistrar registrar(dim_task<DIM>(MOVE_MESH_TASK_ID),
+                                   "move mesh");
     registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
-    Runtime::preregister_task_variant<fill_part_task>(registrar,
-                                                      "fill_partition");
+    Runtime::preregister_task_variant<move_mesh_task<DIM>>(registrar,
+                                                           "move mesh");
   }
   {
-    TaskVariantRegistrar registrar(REMAP_TASK_ID, "remap");
+    TaskVariantRegistrar registrar(dim_task<DIM>(UPDATE_TASK_ID), "update");
     registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
-    Runtime::preregister_task_variant<remap_task>(registrar, "remap");
+    Runtime::preregister_task_variant<update_task<DIM>>(registrar, "update");
+  }
+} // register_mesh_tasks
+
+//------------------------------------------------------------------------
+int main(int argc, char **argv) {
+
+  Runtime::set_top_level_task_id(TOP_LEVEL_TASK_ID);
+  {
+    TaskVariantRegistrar registrar(TOP_LEVEL_TASK_ID, "top_level");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_inner();
+    registrar.set_replicable();
+    Runtime::preregister_task_variant<top_level_task>(registrar, "top_level");
   }
+  register_mesh_tasks<1>();
+  register_mesh_tasks<2>();
+  register_mesh_tasks<3>();
 
   // register custom mapper
   Runtime::add_registration_callback(mapper_registration);
@@ -0,0 +1,175 @@
+#pragma once
+
+/*! @file */
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+/*!
+ Sparse weights of a first-order conservative remap: target cell tgt[k]
+ receives w[k] * source cell src[k]. Entries are sorted by source cell.
+ */
+struct remap_weights_t {
+  std::vector<size_t> src;
+  std::vector<size_t> tgt;
+  std::vector<double> w;
+
+  void clear() {
+    src.clear();
+    tgt.clear();
+    w.clear();
+  }
+}; // remap_weights_t
+
+/*!
+ Geometry of cell g of a uniform mesh with n cells on [0, 1]
+ */
+inline void uniform_cell(size_t g, size_t n, double &xmin, double &xmax) {
+  const double dx = 1.0 / double(n);
+  xmin = double(g) * dx;
+  xmax = (g + 1 == n) ? 1.0 : double(g + 1) * dx;
+} // uniform_cell
+
+/*!
+ Position of node g of a mesh with n cells on [0, 1] whose interior nodes
+ oscillate around their uniform position by up to amplitude cell widths.
+ The nodes stay ordered as long as amplitude < n / (2 pi).
+ */
+inline double moving_node(size_t g, size_t n, double amplitude,
+                          double phase) {
+  if (g == 0)
+    return 0.0;
+  if (g >= n)
+    return 1.0;
+  const double dx = 1.0 / double(n);
+  const double x = double(g) * dx;
+  return x + amplitude * dx * std::sin(2 * M_PI * x) * std::sin(phase);
+} // moving_node
+
+/*!
+ Computes intersection-length weights between a run of source cells and a
+ run of target cells. Both runs must be sorted by position and must not
+ overlap themselves, so a single merge sweep finds every intersecting pair.
+ Weights are normalized by the target cell length.
+ */
+inline void compute_remap_weights(const double *__restrict__ src_xmin,
+                                  const double *__restrict__ src_xmax,
+                                  size_t n_src,
+                                  const double *__restrict__ tgt_xmin,
+                                  const double *__restrict__ tgt_xmax,
+                                  size_t n_tgt, remap_weights_t &weights) {
+  size_t first = 0;
+  for (size_t i = 0; i < n_src; i++) {
+    // skip target cells that end before this source cell starts
+    while (first < n_tgt && tgt_xmax[first] <= src_xmin[i])
+      first++;
+    for (size_t k = first; k < n_tgt && tgt_xmin[k] < src_xmax[i]; k++) {
+      const double len = std::min(src_xmax[i], tgt_xmax[k]) -
+                         std::max(src_xmin[i], tgt_xmin[k]);
+      if (len <= 0)
+        continue;
+      weights.src.push_back(i);
+      weights.tgt.push_back(k);
+      weights.w.push_back(len / (tgt_xmax[k] - tgt_xmin[k]));
+    } // for
+  }   // for
+} // compute_remap_weights
+
+/*!
+ Accumulates weighted source values into the target values
+ */
+inline void apply_remap_weights(const remap_weights_t &weights,
+                                const double *__restrict__ src_val,
+                                double *__restrict__ tgt_val) {
+  const size_t n = weights.w.size();
+  const size_t *__restrict__ src = weights.src.data();
+  const size_t *__restrict__ tgt = weights.tgt.data();
+  const double *__restrict__ w = weights.w.data();
+  for (size_t k = 0; k < n; k++)
+    tgt_val[tgt[k]] += w[k] * src_val[src[k]];
+} // apply_remap_weights
+
+/*!
+ Same as above for values stored with a stride, e.g. one field of an AOS
+ instance. Strides are in elements.
+ */
+inline void apply_remap_weights(const remap_weights_t &weights,
+                                const double *__restrict__ src_val,
+                                size_t src_stride,
+                                double *__restrict__ tgt_val,
+                                size_t tgt_stride) {
+  if (src_stride == 1 && tgt_stride == 1) {
+    apply_remap_weights(weights, src_val, tgt_val);
+    return;
+  }
+  const size_t n = weights.w.size();
+  for (size_t k = 0; k < n; k++)
+    tgt_val[weights.tgt[k] * tgt_stride] +=
+        weights.w[k] * src_val[weights.src[k] * src_stride];
+} // apply_remap_weights
+
+/*!
+ Weights between the cells of two uniform meshes of [0, 1] with n_src and
+ n_tgt cells, e.g. along an axis both meshes resolve uniformly
+ */
+inline void uniform_remap_weights(size_t n_src, size_t n_tgt,
+                                  remap_weights_t &weights) {
+  std::vector<double> src_xmin(n_src), src_xmax(n_src);
+  std::vector<double> tgt_xmin(n_tgt), tgt_xmax(n_tgt);
+  for (size_t g = 0; g < n_src; g++)
+    uniform_cell(g, n_src, src_xmin[g], src_xmax[g]);
+  for (size_t g = 0; g < n_tgt; g++)
+    uniform_cell(g, n_tgt, tgt_xmin[g], tgt_xmax[g]);
+  compute_remap_weights(src_xmin.data(), src_xmax.data(), n_src,
+                        tgt_xmin.data(), tgt_xmax.data(), n_tgt, weights);
+} // uniform_remap_weights
+
+/*!
+ Accumulates weighted source values into the target values of a block of
+ naxes dimensions whose weights are the tensor product of the weights of
+ every axis: target cell (t_0, ..., t_n) receives scale times the product
+ of the per-axis weights times source cell (s_0, ..., s_n). Strides are in
+ elements, one per axis.
+ */
+inline void apply_tensor_weights(const remap_weights_t *const *weights,
+                                 size_t naxes, const double *src_val,
+                                 const size_t *src_stride, double *tgt_val,
+                                 const size_t *tgt_stride,
+                                 double scale = 1.0) {
+  const remap_weights_t &axis = *weights[0];
+  const size_t n = axis.w.size();
+  if (naxes > 1) {
+    for (size_t k = 0; k < n; k++)
+      apply_tensor_weights(weights + 1, naxes - 1,
+                           src_val + axis.src[k] * src_stride[0],
+                           src_stride + 1,
+                           tgt_val + axis.tgt[k] * tgt_stride[0],
+                           tgt_stride + 1, scale * axis.w[k]);
+    return;
+  }
+  if (scale == 1.0) {
+    apply_remap_weights(axis, src_val, src_stride[0], tgt_val, tgt_stride[0]);
+    return;
+  }
+  for (size_t k = 0; k < n; k++)
+    tgt_val[axis.tgt[k] * tgt_stride[0]] +=
+        scale * axis.w[k] * src_val[axis.src[k] * src_stride[0]];
+} // apply_tensor_weights
+
+/*!
+ Sets every value of a block of naxes dimensions with count[d] cells and
+ stride stride[d] along axis d
+ */
+inline void fill_block(double *val, const size_t *count,
+                       const size_t *stride, size_t naxes, double value) {
+  if (naxes > 1) {
+    for (size_t i = 0; i < count[0]; i++)
+      fill_block(val + i * stride[0], count + 1, stride + 1, naxes - 1,
+                 value);
+    return;
+  }
+  for (size_t i = 0; i < count[0]; i++)
+    val[i * stride[0]] = value;
+} // fill_block
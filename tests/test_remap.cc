@@ -0,0 +1,185 @@
+// Unit tests of the Legion-free algorithms of the remap: the remap kernels
+// (remap_kernels.h) and the overlap searches and tracker (overlap.h).
+
+#include "../overlap.h"
+#include "../remap_kernels.h"
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(cond)                                                          \
+  do {                                                                       \
+    if (!(cond)) {                                                           \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__,       \
+              #cond);                                                        \
+      failures++;                                                            \
+    }                                                                        \
+  } while (0)
+
+//------------------------------------------------------------------------
+// Nodes of a mesh with n cells on [0, 1] moved by moving_node
+static void moving_cells(size_t n, double amplitude, double phase,
+                         std::vector<double> &xmin,
+                         std::vector<double> &xmax) {
+  xmin.resize(n);
+  xmax.resize(n);
+  for (size_t g = 0; g < n; g++) {
+    xmin[g] = moving_node(g, n, amplitude, phase);
+    xmax[g] = moving_node(g + 1, n, amplitude, phase);
+  } // for
+} // moving_cells
+
+//------------------------------------------------------------------------
+// The integral of the values, sum of value times cell length, is the same
+// on both meshes after a remap, and constants are remapped exactly
+static void test_weight_conservation() {
+  const size_t n_src = 37, n_tgt = 50;
+  std::vector<double> src_xmin, src_xmax, tgt_xmin, tgt_xmax;
+  moving_cells(n_src, 0.3, 0.7, src_xmin, src_xmax);
+  moving_cells(n_tgt, 0.4, 2.1, tgt_xmin, tgt_xmax);
+
+  remap_weights_t weights;
+  compute_remap_weights(src_xmin.data(), src_xmax.data(), n_src,
+                        tgt_xmin.data(), tgt_xmax.data(), n_tgt, weights);
+
+  // every target cell is covered exactly once
+  std::vector<double> coverage(n_tgt, 0.0);
+  for (size_t k = 0; k < weights.w.size(); k++)
+    coverage[weights.tgt[k]] += weights.w[k];
+  for (double c : coverage)
+    CHECK(std::fabs(c - 1.0) < 1e-12);
+
+  std::vector<double> src_val(n_src), tgt_val(n_tgt, 0.0);
+  double src_sum = 0;
+  for (size_t g = 0; g < n_src; g++) {
+    src_val[g] = 1.0 + std::sin(double(g));
+    src_sum += src_val[g] * (src_xmax[g] - src_xmin[g]);
+  } // for
+  apply_remap_weights(weights, src_val.data(), tgt_val.data());
+  double tgt_sum = 0;
+  for (size_t g = 0; g < n_tgt; g++)
+    tgt_sum += tgt_val[g] * (tgt_xmax[g] - tgt_xmin[g]);
+  CHECK(std::fabs(src_sum - tgt_sum) < 1e-12);
+
+  // the same weights through strided values, as for AOS instances
+  std::vector<double> src_aos(2 * n_src), tgt_aos(3 * n_tgt, 0.0);
+  for (size_t g = 0; g < n_src; g++)
+    src_aos[2 * g] = src_val[g];
+  apply_remap_weights(weights, src_aos.data(), 2, tgt_aos.data(), 3);
+  for (size_t g = 0; g < n_tgt; g++)
+    CHECK(std::fabs(tgt_aos[3 * g] - tgt_val[g]) < 1e-12);
+
+  // the tensor product over two axes conserves the integral as well
+  remap_weights_t cross;
+  uniform_remap_weights(4, 6, cross);
+  const remap_weights_t *axes[2] = {&weights, &cross};
+  std::vector<double> src_2d(n_src * 4, 1.0), tgt_2d(n_tgt * 6);
+  const size_t count[2] = {n_tgt, 6};
+  const size_t src_stride[2] = {4, 1}, tgt_stride[2] = {6, 1};
+  fill_block(tgt_2d.data(), count, tgt_stride, 2, 0.0);
+  apply_tensor_weights(axes, 2, src_2d.data(), src_stride, tgt_2d.data(),
+                       tgt_stride);
+  for (double v : tgt_2d)
+    CHECK(std::fabs(v - 1.0) < 1e-12);
+} // test_weight_conservation
+
+//------------------------------------------------------------------------
+// The BVH finds the same cells as the interval search over sorted cells
+static void test_bvh_matches_interval_search() {
+  const size_t n = 200;
+  std::vector<double> xmin, xmax;
+  moving_cells(n, 0.2, 1.3, xmin, xmax);
+
+  // the BVH is built over the cells in shuffled order, as for the cells of
+  // unstructured meshes
+  std::vector<size_t> shuffled(n);
+  for (size_t i = 0; i < n; i++)
+    shuffled[i] = (i * 37) % n;
+  std::vector<box_t<1>> boxes;
+  for (size_t i : shuffled)
+    boxes.push_back({{xmin[i]}, {xmax[i]}});
+  const bvh_t<1> bvh(boxes);
+  CHECK(bvh.nodes().size() <= bvh_t<1>::max_nodes(n));
+
+  for (size_t q = 0; q < 64; q++) {
+    const double lo = double(q) / 70, hi = lo + 0.003 * double(q % 9 + 1);
+    std::vector<size_t> ids;
+    bvh.query({{lo}, {hi}}, ids);
+    std::vector<size_t> cells;
+    for (size_t id : ids)
+      cells.push_back(shuffled[id]);
+    std::sort(cells.begin(), cells.end());
+
+    size_t first, last;
+    if (!cell_range(xmin.data(), xmax.data(), n, lo, hi, first, last)) {
+      CHECK(cells.empty());
+      continue;
+    }
+    CHECK(cells.size() == last - first + 1);
+    for (size_t k = 0; k < cells.size(); k++)
+      CHECK(cells[k] == first + k);
+  } // for
+
+  // colors found by the interval search over piece extents
+  std::vector<piece_extent_t> extents;
+  for (size_t c = 0; c < 10; c++)
+    extents.push_back({xmin[20 * c], xmax[20 * c + 19], c});
+  const piece_search_t search(extents);
+  std::vector<size_t> colors;
+  search.query(xmin[45], xmax[85], colors);
+  CHECK((colors == std::vector<size_t>{2, 3, 4}));
+} // test_bvh_matches_interval_search
+
+//------------------------------------------------------------------------
+// Colors are only reported dirty once a cell drifted by more than half of
+// the tolerance, and a moving source color dirties the target colors it
+// may overlap
+static void test_tracker_threshold() {
+  const double tolerance = 0.1;
+  overlap_tracker_t tracker(tolerance);
+  const std::vector<piece_extent_t> src = {{0.0, 0.5, 0}, {0.5, 1.0, 1}};
+  const std::vector<piece_extent_t> tgt = {
+      {0.0, 0.25, 0}, {0.25, 0.5, 1}, {0.5, 0.75, 2}, {0.75, 1.0, 3}};
+  const std::vector<double> still(2, 0.0), still_tgt(4, 0.0);
+
+  // everything is dirty until extents are recorded
+  CHECK(tracker.dirty_colors(src, tgt, still, still_tgt).size() == 4);
+  tracker.update(src, tgt, still, {0, 1, 2, 3});
+  CHECK(tracker.dirty_colors(src, tgt, still, still_tgt).empty());
+
+  CHECK(!tracker.moved(tolerance / 2));
+  CHECK(tracker.moved(tolerance / 2 + 1e-9));
+
+  std::vector<double> tgt_drift(still_tgt);
+  tgt_drift[1] = tolerance / 2;
+  CHECK(tracker.dirty_colors(src, tgt, still, tgt_drift).empty());
+  tgt_drift[1] = 0.06;
+  CHECK((tracker.dirty_colors(src, tgt, still, tgt_drift) ==
+         std::vector<size_t>{1}));
+
+  // source color 1 moved into target color 1, which is dirty along with
+  // those it overlapped before
+  std::vector<piece_extent_t> moved_src(src);
+  moved_src[1].lo = 0.44;
+  const std::vector<double> src_drift = {0.0, 0.06};
+  CHECK((tracker.dirty_colors(moved_src, tgt, src_drift, still_tgt) ==
+         std::vector<size_t>{1, 2, 3}));
+  tracker.update(moved_src, tgt, src_drift, {1, 2, 3});
+  CHECK(tracker.dirty_colors(moved_src, tgt, still, still_tgt).empty());
+} // test_tracker_threshold
+
+//------------------------------------------------------------------------
+int main() {
+  test_weight_conservation();
+  test_bvh_matches_interval_search();
+  test_tracker_threshold();
+  if (failures > 0) {
+    fprintf(stderr, "%d checks failed\n", failures);
+    return 1;
+  }
+  printf("all checks passed\n");
+  return 0;
+} // main